@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file change_log_bench.cpp
+ * Measure the cost of appending to the shared memory change log and check
+ * that a reader tailing it sees every transition in order, or an overrun
+ * when it falls more than the ring size behind.
+ ******************************************************************************/
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "change_log.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int arg_count, char** arg_vector) {
+  std::string path = "/dev/shm/change_log_bench";
+  size_t entries = 10000000;
+  size_t capacity = 1 << 16;
+  if (arg_count > 1) {
+    entries = std::stoul(arg_vector[1]);
+  }
+  if (arg_count > 2) {
+    capacity = std::stoul(arg_vector[2]);
+  }
+  unlink(path.c_str());
+  ChangeLog log(path, capacity);
+  ChangeLog::Reader reader(path);
+  uint64_t first = log.nextSequence();
+  uint64_t last = first + entries;
+
+  //Tail the ring like a separate process would
+  size_t seen = 0;
+  size_t overruns = 0;
+  size_t out_of_order = 0;
+  std::thread tail([&]() {
+      uint64_t sequence = first;
+      ChangeLog::Entry entry;
+      while (sequence < last) {
+        switch (reader.read(sequence, entry)) {
+          case ChangeLog::Reader::ok:
+            if (entry.slot != uint32_t(sequence) or entry.time != int64_t(sequence)) {
+              ++out_of_order;
+            }
+            ++seen;
+            ++sequence;
+            break;
+          case ChangeLog::Reader::overrun:
+            ++overruns;
+            sequence = reader.oldest();
+            break;
+          case ChangeLog::Reader::not_yet:
+            break;
+        }
+      }
+    });
+
+  Clock::time_point start = Clock::now();
+  for (uint64_t sequence = first; sequence < last; ++sequence) {
+    log.append(uint32_t(sequence), sequence & 1, int64_t(sequence));
+  }
+  double append_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / entries;
+  tail.join();
+
+  std::cout<<entries<<" transitions through a ring of "<<capacity<<": "<<append_ns<<"ns per append\n";
+  std::cout<<"reader saw "<<seen<<" with "<<overruns<<" overruns and "<<out_of_order<<" bad records\n";
+  unlink(path.c_str());
+  return 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file journal_bench.cpp
+ * Measure the transition journal: the cost of recording a transition on the
+ * publishing thread, the sustained rate at which the writer thread makes
+ * transitions durable with group commit, and the encoded size per record.
+ * Run it on the disk that will hold the journal, with an empty directory.
+ ******************************************************************************/
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "transition_journal.hpp"
+
+//Total size of the files in a directory
+size_t directorySize(const std::string& directory) {
+  size_t total = 0;
+  DIR* dir = opendir(directory.c_str());
+  if (nullptr == dir) {
+    return 0;
+  }
+  while (dirent* entry = readdir(dir)) {
+    struct stat info;
+    if (0 == stat((directory + "/" + entry->d_name).c_str(), &info) and S_ISREG(info.st_mode)) {
+      total += info.st_size;
+    }
+  }
+  closedir(dir);
+  return total;
+}
+
+int main(int arg_count, char** arg_vector) {
+  std::string directory = "journal_bench";
+  size_t transitions = 2000000;
+  int sync_ms = 0;
+  if (arg_count > 1) {
+    directory = arg_vector[1];
+  }
+  if (arg_count > 2) {
+    transitions = std::stoul(arg_vector[2]);
+  }
+  if (arg_count > 3) {
+    sync_ms = std::stoi(arg_vector[3]);
+  }
+  const size_t sensors = 10000;
+
+  typedef std::chrono::steady_clock Clock;
+  TransitionJournal::Config config{directory, sync_ms, 64 * 1024 * 1024};
+  size_t size_before = directorySize(directory);
+  Clock::time_point start;
+  Clock::time_point recorded;
+  Clock::time_point durable;
+  uint64_t first;
+  {
+    TransitionJournal journal(config);
+    for (size_t slot = 0; slot < sensors; ++slot) {
+      std::string uri = "building.floor.room." + std::to_string(slot);
+      journal.name(slot, uri, "closed");
+    }
+    first = journal.nextSequence();
+    int64_t now = 1350000000000;
+    start = Clock::now();
+    for (size_t i = 0; i < transitions; ++i) {
+      now += i % 3;
+      journal.record((i * 7919) % sensors, i & 1, now - 5, now);
+    }
+    recorded = Clock::now();
+    journal.sync();
+    durable = Clock::now();
+  }
+  size_t bytes = directorySize(directory) - size_before;
+
+  size_t scanned = 0;
+  TransitionJournal::scan(directory, first, [&](const TransitionJournal::Transition&) { ++scanned; });
+
+  std::cout<<transitions<<" transitions, sync every "<<sync_ms<<"ms\n";
+  std::cout<<"record: "<<std::chrono::duration<double, std::nano>(recorded - start).count() / transitions<<
+    " ns/transition on the publishing thread\n";
+  std::cout<<"durable: "<<transitions / std::chrono::duration<double>(durable - start).count()<<
+    " transitions/sec\n";
+  std::cout<<"size: "<<double(bytes) / transitions<<" bytes/transition\n";
+  std::cout<<"read back "<<scanned<<" transitions\n";
+  return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file priority_lanes_bench.cpp
+ * Simulate a door storm that offers more transitions than the world model
+ * connection can take, mixed with occasional water leaks, and report the
+ * latency of each solution from its change to its publish with a single
+ * lane, with the leaks in a lane of their own, with the door lane shed
+ * while the connection is overloaded, and with the updates rate limited
+ * below what the connection can take. Time is simulated, with a
+ * send costing a fixed overhead plus a cost per transition, so the results
+ * do not depend on the machine.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "load_shedder.hpp"
+#include "priority_lanes.hpp"
+#include "state_store.hpp"
+#include "token_bucket.hpp"
+
+struct Config {
+  const char* name;
+  std::map<std::string, int> priorities;
+  size_t batch_limit;
+  LoadShedder::Config shed;
+  //Updates per second, 0 for no limit
+  double max_rate;
+};
+
+struct Load {
+  size_t doors;
+  size_t leaks;
+  //Offered changes per second
+  double door_rate;
+  double leak_rate;
+  //Cost of one send in microseconds
+  int64_t send_us;
+  int64_t per_transition_us;
+  int64_t seconds;
+};
+
+void report(const std::string& name, std::vector<int64_t>& latencies) {
+  if (latencies.empty()) {
+    std::cout<<"  "<<name<<": nothing published\n";
+    return;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  auto at = [&](double fraction) { return latencies[size_t(fraction * (latencies.size() - 1))] / 1000.0; };
+  std::cout<<"  "<<name<<": "<<latencies.size()<<" published, p50 "<<at(0.5)<<"ms p99 "<<at(0.99)<<
+    "ms max "<<latencies.back() / 1000.0<<"ms\n";
+}
+
+void run(const Config& config, const Load& load) {
+  size_t slots = load.doors + load.leaks;
+  StateStore states;
+  states.resize(slots);
+  PriorityLanes lanes(config.priorities, config.batch_limit);
+  LoadShedder shedder(config.shed);
+  TokenBucket bucket(config.max_rate, config.max_rate / 100);
+  lanes.resize(slots);
+  for (size_t slot = 0; slot < slots; ++slot) {
+    lanes.assign(slot, slot < load.doors ? "closed" : "wet");
+  }
+  std::vector<int64_t> changed_at(slots, 0);
+  std::vector<int64_t> door_latency;
+  std::vector<int64_t> leak_latency;
+
+  std::mt19937 rng(11);
+  std::uniform_int_distribution<size_t> pick_door(0, load.doors - 1);
+  std::uniform_int_distribution<size_t> pick_leak(load.doors, slots - 1);
+  std::bernoulli_distribution leak_this_ms(load.leak_rate / 1000.0);
+  std::vector<bool> values(slots, false);
+
+  int64_t now = 0;
+  int64_t next_tick = 0;
+  int64_t end = load.seconds * 1000000;
+  while (now < end) {
+    //Samples arrive every millisecond
+    for (; next_tick <= now; next_tick += 1000) {
+      auto change = [&](size_t slot) {
+        if (not states.isDirty(slot)) {
+          changed_at[slot] = next_tick;
+        }
+        values[slot] = not values[slot];
+        states.update(slot, values[slot]);
+      };
+      for (size_t i = 0; i < load.door_rate / 1000; ++i) {
+        change(pick_door(rng));
+      }
+      if (leak_this_ms(rng)) {
+        change(pick_leak(rng));
+      }
+    }
+    bucket.refill(now);
+    size_t collected = lanes.collect(states, bucket.available());
+    bucket.limited(lanes.lastLimited());
+    if (shedder.enabled() and shedder.observe(now / 1000, lanes.lastWaiting(), lanes.heldBack())) {
+      lanes.shedBelow(shedder.shedBelow(), states);
+    }
+    if (0 == collected) {
+      now = next_tick;
+      continue;
+    }
+    for (PriorityLanes::Lane& lane : lanes.laneList()) {
+      if (lane.queued.empty()) {
+        continue;
+      }
+      now += load.send_us + load.per_transition_us * lane.queued.size();
+      bucket.take(lane.queued.size());
+      for (size_t slot : lane.queued) {
+        (slot < load.doors ? door_latency : leak_latency).push_back(now - changed_at[slot]);
+      }
+      lane.queued.clear();
+    }
+  }
+  std::cout<<config.name<<":\n";
+  report("closed", door_latency);
+  report("wet", leak_latency);
+  if (bucket.enabled()) {
+    std::cout<<"  "<<bucket.taken()<<" updates sent, "<<bucket.limitedCount()<<" waited for tokens\n";
+  }
+  if (shedder.enabled()) {
+    std::cout<<"  "<<shedder.events()<<" shedding events, "<<lanes.shedCount()<<" sensors still shed\n";
+  }
+}
+
+int main(int arg_count, char** arg_vector) {
+  Load load{100000, 1000, 200000, 20, 200, 10, 10};
+  size_t batch_limit = 1000;
+  if (arg_count > 1) {
+    load.door_rate = std::stod(arg_vector[1]);
+  }
+  if (arg_count > 2) {
+    batch_limit = std::stoul(arg_vector[2]);
+  }
+  std::cout<<load.door_rate<<" door and "<<load.leak_rate<<" leak changes/s offered, about "<<
+    1000000 / load.per_transition_us<<" transitions/s can be sent\n";
+  LoadShedder::Config no_shedding{0, 0, 0};
+  run(Config{"one lane", {}, 0, no_shedding, 0}, load);
+  run(Config{"wet in a priority lane", {{"wet", 1}}, batch_limit, no_shedding, 0}, load);
+  run(Config{"wet in a priority lane, doors shed", {{"wet", 1}, {"closed", -1}}, batch_limit,
+             LoadShedder::Config{4 * batch_limit, 500, 1000}, 0}, load);
+  run(Config{"wet in a priority lane, 50000 updates/s", {{"wet", 1}}, batch_limit, no_shedding, 50000}, load);
+  return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file reactor_bench.cpp
+ * Compare the system calls per sample of the epoll and io_uring reactor
+ * backends. A client sends bursts of fixed size samples over several
+ * loopback connections and the reactor acknowledges every sample, the way
+ * the solver receives data and writes solutions over many connections.
+ ******************************************************************************/
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "reactor.hpp"
+
+const size_t sample_size = 32;
+const size_t ack_size = 8;
+
+//Connect num pairs of loopback TCP sockets
+void connectPairs(size_t num, std::vector<int>& clients, std::vector<int>& servers) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (0 != bind(listener, (sockaddr*)&addr, len) or 0 != listen(listener, num) or
+      0 != getsockname(listener, (sockaddr*)&addr, &len)) {
+    throw std::runtime_error("Could not listen on loopback");
+  }
+  int one = 1;
+  for (size_t i = 0; i < num; ++i) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    if (0 != connect(client, (sockaddr*)&addr, len)) {
+      throw std::runtime_error("Could not connect on loopback");
+    }
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    int server = accept(listener, nullptr, nullptr);
+    setsockopt(server, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    clients.push_back(client);
+    servers.push_back(server);
+  }
+  close(listener);
+}
+
+//Send bursts of samples round robin over the connections and wait for the
+//acknowledgements of each burst before sending the next one.
+void client(std::vector<int> fds, size_t samples, size_t burst) {
+  char sample[sample_size];
+  memset(sample, 's', sizeof(sample));
+  std::vector<pollfd> polls;
+  for (int fd : fds) {
+    polls.push_back(pollfd{fd, POLLIN, 0});
+  }
+  char acks[4096];
+  size_t sent = 0;
+  while (sent < samples) {
+    size_t this_burst = std::min(burst, samples - sent);
+    for (size_t i = 0; i < this_burst; ++i) {
+      if (sample_size != send(fds[(sent + i) % fds.size()], sample, sample_size, 0)) {
+        throw std::runtime_error("Short send");
+      }
+    }
+    sent += this_burst;
+    size_t acked = 0;
+    while (acked < this_burst * ack_size) {
+      poll(polls.data(), polls.size(), -1);
+      for (pollfd& p : polls) {
+        if (p.revents & POLLIN) {
+          ssize_t got = recv(p.fd, acks, sizeof(acks), 0);
+          if (got <= 0) {
+            throw std::runtime_error("Connection closed");
+          }
+          acked += got;
+        }
+      }
+    }
+  }
+}
+
+void run(const std::string& backend, size_t connections, size_t samples, size_t burst) {
+  std::unique_ptr<Reactor> reactor;
+  try {
+    reactor = Reactor::create(backend);
+  }
+  catch (std::runtime_error& err) {
+    std::cout<<backend<<": unavailable ("<<err.what()<<")\n";
+    return;
+  }
+  std::vector<int> clients;
+  std::vector<int> servers;
+  connectPairs(connections, clients, servers);
+
+  size_t received = 0;
+  std::vector<size_t> partial(servers.size(), 0);
+  char ack[ack_size];
+  memset(ack, 'a', sizeof(ack));
+  for (size_t i = 0; i < servers.size(); ++i) {
+    int fd = servers[i];
+    reactor->addReceiver(fd, [&, i, fd](const char*, size_t length) {
+      partial[i] += length;
+      while (partial[i] >= sample_size) {
+        partial[i] -= sample_size;
+        ++received;
+        reactor->send(fd, ack, ack_size);
+      }
+    });
+  }
+
+  uint64_t start_syscalls = reactor->syscalls();
+  auto start = std::chrono::steady_clock::now();
+  std::thread sender(client, clients, samples, burst);
+  while (received < samples) {
+    reactor->wait(100);
+  }
+  //Push out the last acknowledgements
+  while (true) {
+    size_t pending = 0;
+    for (int fd : servers) {
+      pending += reactor->pendingBytes(fd);
+    }
+    if (0 == pending) {
+      break;
+    }
+    reactor->wait(1);
+  }
+  sender.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  uint64_t syscalls = reactor->syscalls() - start_syscalls;
+
+  std::cout<<reactor->name()<<": "<<double(syscalls) / samples<<" syscalls/sample, "<<
+    samples / seconds<<" samples/sec\n";
+  for (size_t i = 0; i < servers.size(); ++i) {
+    reactor->remove(servers[i]);
+    close(servers[i]);
+    close(clients[i]);
+  }
+}
+
+int main(int arg_count, char** arg_vector) {
+  size_t connections = 8;
+  size_t samples = 200000;
+  size_t burst = 64;
+  if (arg_count > 1) {
+    connections = std::stoul(arg_vector[1]);
+  }
+  if (arg_count > 2) {
+    samples = std::stoul(arg_vector[2]);
+  }
+  if (arg_count > 3) {
+    burst = std::stoul(arg_vector[3]);
+  }
+  std::cout<<samples<<" samples over "<<connections<<" connections in bursts of "<<burst<<'\n';
+  run("epoll", connections, samples, burst);
+  run("io_uring", connections, samples, burst);
+  return 0;
+}
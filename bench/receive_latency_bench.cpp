@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file receive_latency_bench.cpp
+ * Measure the latency from send to receive over a loopback TCP connection
+ * for the event driven receive mode (block in the reactor until readable)
+ * and the busy poll mode (non-blocking reads with a bounded spin budget
+ * before falling back to the reactor). Run with the receiver pinned to an
+ * otherwise idle core, e.g. with taskset, for meaningful busy poll numbers.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "reactor.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+//Make a connected pair of loopback TCP sockets
+std::pair<int, int> connectedPair() {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t len = sizeof(addr);
+  if (0 != bind(listener, (sockaddr*)&addr, len) or 0 != listen(listener, 1) or
+      0 != getsockname(listener, (sockaddr*)&addr, &len)) {
+    throw std::runtime_error("Could not listen on loopback");
+  }
+  int sender = socket(AF_INET, SOCK_STREAM, 0);
+  if (0 != connect(sender, (sockaddr*)&addr, len)) {
+    throw std::runtime_error("Could not connect on loopback");
+  }
+  int receiver = accept(listener, nullptr, nullptr);
+  close(listener);
+  int one = 1;
+  setsockopt(sender, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return std::make_pair(sender, receiver);
+}
+
+//Send timestamps with random gaps so that the receiver is often idle
+void produce(int fd, size_t messages, int interval_us) {
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<int> gap(interval_us / 2, interval_us * 3 / 2);
+  for (size_t i = 0; i < messages; ++i) {
+    std::this_thread::sleep_for(std::chrono::microseconds(gap(rng)));
+    int64_t now = Clock::now().time_since_epoch().count();
+    if (sizeof(now) != send(fd, &now, sizeof(now), 0)) {
+      throw std::runtime_error("Short send");
+    }
+  }
+}
+
+//Read whatever is available and record the latency of every whole message
+class Receiver {
+  private:
+    int fd;
+    char partial[sizeof(int64_t)];
+    size_t have;
+
+  public:
+    std::vector<double> latencies_us;
+
+    Receiver(int fd) : fd(fd), have(0) {}
+
+    bool receive() {
+      char buff[4096];
+      ssize_t got = recv(fd, buff, sizeof(buff), 0);
+      if (got <= 0) {
+        return false;
+      }
+      Clock::time_point now = Clock::now();
+      for (ssize_t i = 0; i < got; ++i) {
+        partial[have++] = buff[i];
+        if (sizeof(int64_t) == have) {
+          int64_t sent;
+          memcpy(&sent, partial, sizeof(sent));
+          Clock::time_point then{Clock::duration(sent)};
+          latencies_us.push_back(std::chrono::duration<double, std::micro>(now - then).count());
+          have = 0;
+        }
+      }
+      return true;
+    }
+};
+
+void report(const std::string& mode, std::vector<double> latencies) {
+  std::sort(latencies.begin(), latencies.end());
+  auto at = [&](double fraction) { return latencies[std::min(latencies.size() - 1, size_t(fraction * latencies.size()))]; };
+  std::cout<<mode<<": p50 "<<at(0.50)<<"us p99 "<<at(0.99)<<"us p99.9 "<<at(0.999)<<
+    "us max "<<latencies.back()<<"us\n";
+}
+
+std::vector<double> run(size_t messages, int interval_us, unsigned int spin_budget) {
+  std::pair<int, int> fds = connectedPair();
+  Reactor::setNonBlocking(fds.second);
+  Receiver receiver(fds.second);
+  std::unique_ptr<Reactor> reactor = Reactor::create("epoll");
+  if (0 == spin_budget) {
+    //Event driven: read from the readiness callback
+    reactor->add(fds.second, [&]() { while (receiver.receive()); });
+  }
+  else {
+    //Busy poll: the loop reads, the reactor only wakes us up
+    reactor->add(fds.second, []() {});
+    if (not Reactor::enableBusyPoll(fds.second, 50)) {
+      std::cerr<<"SO_BUSY_POLL is not available, spinning in user space only\n";
+    }
+  }
+  IdlePolicy idle(spin_budget, 100);
+
+  std::thread producer(produce, fds.first, messages, interval_us);
+  while (receiver.latencies_us.size() < messages) {
+    if (0 == spin_budget) {
+      reactor->wait(100);
+    }
+    else {
+      bool did_work = false;
+      while (receiver.receive()) {
+        did_work = true;
+      }
+      idle.idle(did_work, *reactor);
+    }
+  }
+  producer.join();
+  reactor->remove(fds.second);
+  close(fds.first);
+  close(fds.second);
+  return receiver.latencies_us;
+}
+
+int main(int arg_count, char** arg_vector) {
+  size_t messages = 20000;
+  int interval_us = 200;
+  unsigned int spin_budget = 1000000;
+  if (arg_count > 1) {
+    messages = std::stoul(arg_vector[1]);
+  }
+  if (arg_count > 2) {
+    interval_us = std::stoi(arg_vector[2]);
+  }
+  if (arg_count > 3) {
+    spin_budget = std::stoul(arg_vector[3]);
+  }
+  std::cout<<messages<<" messages about every "<<interval_us<<"us\n";
+  report("event driven", run(messages, interval_us, 0));
+  report("busy poll (" + std::to_string(spin_budget) + " spins)", run(messages, interval_us, spin_budget));
+  return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file rule_engine_bench.cpp
+ * Measure the cost of re-evaluating rules after a sensor change. Every room
+ * has door and water sensors and a rule for whether it is secure, and every
+ * floor has a rule combining the rules of its rooms. Random sensors then
+ * change state one at a time.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "rule_engine.hpp"
+
+typedef std::chrono::steady_clock Clock;
+
+int main(int arg_count, char** arg_vector) {
+  size_t rooms = 5000;
+  size_t sensors_per_room = 200;
+  size_t changes = 1000000;
+  if (arg_count > 1) {
+    rooms = std::stoul(arg_vector[1]);
+  }
+  if (arg_count > 2) {
+    sensors_per_room = std::stoul(arg_vector[2]);
+  }
+  if (arg_count > 3) {
+    changes = std::stoul(arg_vector[3]);
+  }
+  const size_t rooms_per_floor = 10;
+
+  RuleEngine rules;
+  Clock::time_point start = Clock::now();
+  for (size_t room = 0; room < rooms; ++room) {
+    std::string uri = "bench.room" + std::to_string(room);
+    rules.addRule(uri, "secure", "all(closed, " + uri + ".) and not any(wet, " + uri + ".)");
+  }
+  for (size_t floor = 0; floor * rooms_per_floor < rooms; ++floor) {
+    std::string expression = "true";
+    for (size_t room = floor * rooms_per_floor; room < std::min(rooms, (floor + 1) * rooms_per_floor); ++room) {
+      expression += " and secure(bench.room" + std::to_string(room) + ")";
+    }
+    rules.addRule("bench.floor" + std::to_string(floor), "secure", expression);
+  }
+  rules.compile();
+  double compile_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+  start = Clock::now();
+  size_t sensors = rooms * sensors_per_room;
+  for (size_t slot = 0; slot < sensors; ++slot) {
+    size_t room = slot / sensors_per_room;
+    size_t index = slot % sensors_per_room;
+    bool door = index < sensors_per_room / 2;
+    rules.assign(slot, "bench.room" + std::to_string(room) + (door ? ".door" : ".floor") + std::to_string(index),
+                 door ? "closed" : "wet");
+    rules.update(slot, door);
+  }
+  double assign_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  rules.drainDirty([](uint32_t, const RuleEngine::Output&, bool) {});
+
+  std::mt19937 rng(7);
+  std::uniform_int_distribution<size_t> pick(0, sensors - 1);
+  std::vector<bool> values(sensors);
+  for (size_t slot = 0; slot < sensors; ++slot) {
+    values[slot] = slot % sensors_per_room < sensors_per_room / 2;
+  }
+  size_t published = 0;
+  start = Clock::now();
+  for (size_t i = 0; i < changes; ++i) {
+    size_t slot = pick(rng);
+    values[slot] = not values[slot];
+    rules.update(slot, values[slot]);
+    if (0 == i % 1024) {
+      rules.drainDirty([&](uint32_t, const RuleEngine::Output&, bool) { ++published; });
+    }
+  }
+  double update_ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / changes;
+
+  std::cout<<rules.rules().size()<<" rules, "<<rules.nodeCount()<<" nodes over "<<sensors<<" sensors\n";
+  std::cout<<"compile "<<compile_ms<<"ms, assign "<<assign_ms<<"ms\n";
+  std::cout<<update_ns<<"ns per change, "<<published<<" results published\n";
+  return 0;
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file sensor_table_bench.cpp
+ * Compare one-at-a-time transmitter lookups against batched lookups with
+ * group prefetching. Use a table size larger than the last level cache to
+ * see the effect of overlapping cache misses.
+ ******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sensor_table.hpp"
+#include "utf8.hpp"
+
+int main(int arg_count, char** arg_vector) {
+  size_t num_sensors = 4000000;
+  size_t batch_size = 256;
+  size_t num_lookups = 8000000;
+  if (arg_count > 1) {
+    num_sensors = std::stoul(arg_vector[1]);
+  }
+  if (arg_count > 2) {
+    batch_size = std::stoul(arg_vector[2]);
+  }
+  if (arg_count > 3) {
+    num_lookups = std::stoul(arg_vector[3]);
+  }
+
+  std::cout<<"Building a table of "<<num_sensors<<" transmitters\n";
+  SensorTable table;
+  //Samples name their transmitters in UTF-16, as the world model sends them
+  std::vector<std::u16string> names;
+  names.reserve(num_sensors);
+  for (size_t i = 0; i < num_sensors; ++i) {
+    std::string str = "1." + std::to_string(i * 7919 + 13);
+    names.push_back(utf8::decode(str));
+    bool changed;
+    table.assign(str, "object." + str, "closed", changed);
+  }
+  std::cout<<"names and URIs take "<<table.stringBytes()<<" bytes\n";
+
+  //Random lookups, as a burst of samples from many transmitters would do
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> pick(0, num_sensors - 1);
+  std::vector<const std::u16string*> keys(num_lookups);
+  for (const std::u16string*& key : keys) {
+    key = &names[pick(rng)];
+  }
+  std::vector<SensorTable::Slot> slots(num_lookups);
+
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_lookups; ++i) {
+    slots[i] = table.find(utf8::encode(*keys[i]));
+  }
+  double single = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  uint64_t check_single = 0;
+  for (SensorTable::Slot slot : slots) {
+    check_single += slot;
+  }
+
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < num_lookups; i += batch_size) {
+    size_t count = std::min(batch_size, num_lookups - i);
+    table.findBatch(&keys[i], count, &slots[i]);
+  }
+  double batched = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  uint64_t check_batched = 0;
+  for (SensorTable::Slot slot : slots) {
+    check_batched += slot;
+  }
+
+  if (check_single != check_batched) {
+    std::cerr<<"Batched lookups returned different slots!\n";
+    return 1;
+  }
+  std::cout<<"one at a time: "<<num_lookups / single<<" samples/sec\n";
+  std::cout<<"batched ("<<batch_size<<"): "<<num_lookups / batched<<" samples/sec\n";
+  std::cout<<"speedup: "<<single / batched<<"x\n";
+  return 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "admin_socket.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+  //Longest command line accepted from a client
+  const size_t max_line = 4096;
+
+  void clearEventfd(int fd) {
+    uint64_t count;
+    while (sizeof(count) == read(fd, &count, sizeof(count)));
+  }
+
+  bool writeAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+      ssize_t wrote = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+      if (0 > wrote) {
+        if (EINTR == errno) {
+          continue;
+        }
+        return false;
+      }
+      sent += wrote;
+    }
+    return true;
+  }
+}
+
+AdminSocket::AdminSocket(const std::string& path, std::function<void()> on_start) :
+  path(path), listen_fd(-1), wake_fd(-1), stop_fd(-1), on_start(on_start), stopping(false), queued(false) {
+  listen_fd = listenUnix(path);
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (0 > wake_fd or 0 > stop_fd) {
+    std::string error = strerror(errno);
+    //The caller may carry on without us, so leave no socket behind
+    for (int fd : {listen_fd, wake_fd, stop_fd}) {
+      if (0 <= fd) {
+        close(fd);
+      }
+    }
+    unlink(path.c_str());
+    throw std::runtime_error("Could not create an eventfd: " + error);
+  }
+  server = std::thread(&AdminSocket::run, this);
+}
+
+int AdminSocket::listenUnix(const std::string& path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Socket path is too long: " + path);
+  }
+  strcpy(addr.sun_path, path.c_str());
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  //Only a socket left behind by an earlier run is removed
+  if (0 == access(path.c_str(), F_OK) and 0 != connect(fd, (sockaddr*)&addr, sizeof(addr))) {
+    unlink(path.c_str());
+  }
+  close(fd);
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (0 > fd or 0 != bind(fd, (sockaddr*)&addr, sizeof(addr)) or 0 != listen(fd, 8)) {
+    std::string error = strerror(errno);
+    if (0 <= fd) {
+      close(fd);
+    }
+    throw std::runtime_error("Could not listen on " + path + ": " + error);
+  }
+  return fd;
+}
+
+AdminSocket::~AdminSocket() {
+  uint64_t one = 1;
+  if (sizeof(one) != write(stop_fd, &one, sizeof(one))) {
+    std::cerr<<"Could not stop the admin socket thread\n";
+  }
+  {
+    //Release a client waiting for a command that will never run
+    std::unique_lock<std::mutex> guard(lock);
+    stopping = true;
+    for (Request* request : requests) {
+      request->reply = "error: shutting down\n";
+      request->done = true;
+    }
+    requests.clear();
+    answered.notify_all();
+  }
+  server.join();
+  close(listen_fd);
+  close(wake_fd);
+  close(stop_fd);
+  unlink(path.c_str());
+}
+
+void AdminSocket::watch(Reactor& reactor) {
+  reactor.add(wake_fd, [this]() { clearEventfd(wake_fd); });
+}
+
+std::string AdminSocket::submit(const std::string& command) {
+  Request request{command, std::string(), false};
+  std::unique_lock<std::mutex> guard(lock);
+  if (stopping) {
+    return "error: shutting down\n";
+  }
+  requests.push_back(&request);
+  queued.store(true, std::memory_order_release);
+  uint64_t one = 1;
+  if (sizeof(one) != write(wake_fd, &one, sizeof(one))) {
+    std::cerr<<"Could not wake the event loop for an admin command\n";
+  }
+  answered.wait(guard, [&]() { return request.done; });
+  return request.reply;
+}
+
+size_t AdminSocket::serve(const Handler& handler) {
+  std::unique_lock<std::mutex> guard(lock);
+  size_t served = 0;
+  while (not requests.empty()) {
+    Request* request = requests.front();
+    requests.pop_front();
+    //Run the command without holding the lock so new commands can queue
+    guard.unlock();
+    std::string reply;
+    try {
+      reply = handler(request->command);
+    }
+    catch (std::exception& err) {
+      reply = std::string("error: ") + err.what() + '\n';
+    }
+    guard.lock();
+    request->reply = reply;
+    request->done = true;
+    ++served;
+  }
+  queued.store(false, std::memory_order_release);
+  answered.notify_all();
+  return served;
+}
+
+void AdminSocket::run() {
+  if (on_start) {
+    on_start();
+  }
+  //Partial command lines of the connected clients
+  std::map<int, std::string> clients;
+  while (true) {
+    std::vector<pollfd> polls{pollfd{stop_fd, POLLIN, 0}, pollfd{listen_fd, POLLIN, 0}};
+    for (auto& client : clients) {
+      polls.push_back(pollfd{client.first, POLLIN, 0});
+    }
+    if (0 > poll(polls.data(), polls.size(), -1)) {
+      if (EINTR == errno) {
+        continue;
+      }
+      std::cerr<<"Admin socket poll failed: "<<strerror(errno)<<'\n';
+      break;
+    }
+    if (polls[0].revents) {
+      break;
+    }
+    if (polls[1].revents & POLLIN) {
+      int client = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (0 <= client) {
+        clients[client];
+      }
+    }
+    for (size_t i = 2; i < polls.size(); ++i) {
+      if (0 == polls[i].revents) {
+        continue;
+      }
+      int fd = polls[i].fd;
+      std::string& partial = clients[fd];
+      char buff[1024];
+      ssize_t got = recv(fd, buff, sizeof(buff), 0);
+      bool keep = 0 < got;
+      if (keep) {
+        partial.append(buff, got);
+      }
+      size_t end;
+      while (keep and std::string::npos != (end = partial.find('\n'))) {
+        std::string command = partial.substr(0, end);
+        partial.erase(0, end + 1);
+        if (not command.empty() and '\r' == command.back()) {
+          command.pop_back();
+        }
+        keep = writeAll(fd, submit(command) + '\n');
+      }
+      if (partial.size() > max_line) {
+        writeAll(fd, "error: command too long\n\n");
+        keep = false;
+      }
+      if (not keep) {
+        close(fd);
+        clients.erase(fd);
+      }
+    }
+  }
+  for (auto& client : clients) {
+    close(client.first);
+  }
+}
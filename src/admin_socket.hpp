@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file admin_socket.hpp
+ * A local control socket for operators. A background thread accepts
+ * connections on a Unix domain socket and reads one command per line, so
+ * slow or idle clients never touch the ingest thread. Each command is
+ * handed to the ingest thread, which is woken through an eventfd in its
+ * reactor and runs the command between two batches; the background thread
+ * then writes the reply. Commands therefore see and change the solver's
+ * state without locks and without pausing ingest for longer than the
+ * command itself takes.
+ *
+ * A reply is any number of lines followed by an empty line.
+ ******************************************************************************/
+
+#ifndef __ADMIN_SOCKET_HPP__
+#define __ADMIN_SOCKET_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "reactor.hpp"
+
+class AdminSocket {
+  public:
+    ///Run one command line and return its reply.
+    typedef std::function<std::string(const std::string&)> Handler;
+
+  private:
+    struct Request {
+      std::string command;
+      std::string reply;
+      bool done;
+    };
+
+    std::string path;
+    int listen_fd;
+    //Wakes the ingest thread when a command is queued
+    int wake_fd;
+    //Stops the background thread
+    int stop_fd;
+    std::function<void()> on_start;
+
+    std::mutex lock;
+    std::condition_variable answered;
+    std::deque<Request*> requests;
+    bool stopping;
+    std::atomic<bool> queued;
+    std::thread server;
+
+    AdminSocket(const AdminSocket&) = delete;
+    AdminSocket& operator=(const AdminSocket&) = delete;
+
+    ///Accept clients and forward their commands until stopped.
+    void run();
+    ///Queue a command for the ingest thread and wait for its reply.
+    std::string submit(const std::string& command);
+
+  public:
+    /**
+     * Listen on a Unix domain socket at path, replacing a stale socket
+     * file, and start the background thread, which calls on_start first.
+     * Throws std::runtime_error if the socket cannot be created.
+     */
+    AdminSocket(const std::string& path, std::function<void()> on_start = std::function<void()>());
+    ~AdminSocket();
+
+    /**
+     * Listen on a Unix domain socket at path, replacing a socket file that
+     * no process is listening on.
+     * @return The listening socket.
+     * Throws std::runtime_error if the socket cannot be created.
+     */
+    static int listenUnix(const std::string& path);
+
+    ///Wake the event loop when a command is waiting.
+    void watch(Reactor& reactor);
+
+    ///True if a command is waiting to be run.
+    bool pending() const { return queued.load(std::memory_order_acquire); }
+
+    /**
+     * Run every waiting command with handler on the calling thread.
+     * @return The number of commands run.
+     */
+    size_t serve(const Handler& handler);
+};
+
+#endif //__ADMIN_SOCKET_HPP__
@@ -28,19 +28,24 @@
 
 #include <algorithm>
 #include <array>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <thread>
 #include <time.h>
 #include <unistd.h>
 #include <utility>
 #include <vector>
 #include <sstream>
 
-//Handle interrupt signals to exit cleanly.
-#include <signal.h>
-
 #include <owl/netbuffer.hpp>
 #include <owl/solver_aggregator_connection.hpp>
 #include <owl/solver_world_connection.hpp>
@@ -50,6 +55,33 @@
 
 #include <owl/client_world_connection.hpp>
 
+#include "admin_socket.hpp"
+#include "change_feed.hpp"
+#include "change_log.hpp"
+#include "enum_solutions.hpp"
+#include "group_aggregates.hpp"
+#include "huge_pages.hpp"
+#include "load_shedder.hpp"
+#include "open_alerts.hpp"
+#include "options.hpp"
+#include "priority_lanes.hpp"
+#include "publish_throttle.hpp"
+#include "publish_ledger.hpp"
+#include "reactor.hpp"
+#include "rule_engine.hpp"
+#include "sensor_history.hpp"
+#include "sensor_table.hpp"
+#include "shutdown_signals.hpp"
+#include "state_kernels.hpp"
+#include "state_snapshot.hpp"
+#include "state_store.hpp"
+#include "thread_placement.hpp"
+#include "time_in_state.hpp"
+#include "token_bucket.hpp"
+#include "transition_journal.hpp"
+#include "uri_index.hpp"
+#include "utf8.hpp"
+
 using namespace aggregator_solver;
 
 using std::pair;
@@ -58,26 +90,788 @@ using world_model::Attribute;
 using world_model::grail_time;
 using world_model::URI;
 
-//Global variable for the signal handler.
-bool interrupted = false;
-//Signal handler.
-void handler(int signal) {
-  psignal( signal, "Received signal ");
-  if (interrupted) {
-    std::cerr<<"Aborting.\n";
-    // This is the second time we've received the interrupt, so just exit.
-    exit(-1);
-  }
-  std::cerr<<"Shutting down...\n";
-  interrupted = true;
+typedef std::chrono::steady_clock::time_point Deadline;
+
+/**
+ * Send solutions to the world model, retrying while the socket reports that
+ * it is temporarily unavailable. Each retry waits twice as long as the one
+ * before, up to 64ms, so that a full socket is not hammered with writes.
+ * Throws std::runtime_error if the data could not be sent before the
+ * deadline.
+ * @param create_uris Create objects that do not exist in the world model yet.
+ */
+void sendSolutions(SolverWorldModel& swm, std::vector<SolverWorldModel::AttrUpdate>& solns,
+                   Deadline deadline = Deadline::max(), bool create_uris = false) {
+  const std::chrono::milliseconds max_backoff(64);
+  std::chrono::milliseconds backoff(1);
+  bool retry = true;
+  while (retry) {
+    try {
+      retry = false;
+      swm.sendData(solns, create_uris);
+    }
+    catch (std::runtime_error& err) {
+      //Retry if this is just a temporary socket error
+      if (err.what() == std::string("Error sending data over socket: Resource temporarily unavailable")) {
+        Deadline now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+          throw std::runtime_error("Timed out sending solutions to the world model");
+        }
+        if (1 == backoff.count()) {
+          std::cerr<<"Experiencing socket slow down with world model connection. Retrying...\n";
+        }
+        std::this_thread::sleep_until(std::min(now + backoff, deadline));
+        backoff = std::min(backoff * 2, max_backoff);
+        retry = true;
+      }
+      //Otherwise keep throwing
+      else {
+        throw err;
+      }
+    }
+  }
+}
+
+//The optional consumers of published transitions, null when disabled
+struct TransitionSinks {
+  TransitionJournal* journal;
+  PublishLedger* ledger;
+  TimeInState* time_in_state;
+  GroupAggregates* aggregates;
+  RuleEngine* rules;
+  OpenAlerts* alerts;
+  SensorHistory* history;
+  ChangeFeed* feed;
+  ChangeLog* change_log;
+};
+
+/**
+ * Publish the counts of every group that changed as solutions of the group
+ * URIs, creating the group objects as needed. Groups stay dirty if sending
+ * fails.
+ */
+void publishAggregates(SolverWorldModel& swm, GroupAggregates& aggregates, Deadline deadline) {
+  std::vector<SolverWorldModel::AttrUpdate> solns;
+  std::vector<uint32_t> groups;
+  world_model::grail_time now = world_model::getGRAILTime();
+  aggregates.drainDirty([&](uint32_t index, const GroupAggregates::Group& group) {
+      groups.push_back(index);
+      URI uri = utf8::decode(group.uri);
+      SolverWorldModel::AttrUpdate count{utf8::decode(group.solution + ".count"), now, uri, std::vector<uint8_t>()};
+      pushBackVal<uint32_t>(group.count, count.data);
+      solns.push_back(count);
+      SolverWorldModel::AttrUpdate count_true{utf8::decode(group.solution + ".count_true"), now, uri,
+                                              std::vector<uint8_t>()};
+      pushBackVal<uint32_t>(group.count_true, count_true.data);
+      solns.push_back(count_true);
+    });
+  try {
+    sendSolutions(swm, solns, deadline, true);
+  }
+  catch (std::runtime_error& err) {
+    for (uint32_t index : groups) {
+      aggregates.markDirty(index);
+    }
+    throw;
+  }
+}
+
+/**
+ * Publish the result of every rule that changed as a solution of the rule's
+ * object, creating the object as needed. Rules stay dirty if sending fails.
+ */
+void publishRules(SolverWorldModel& swm, RuleEngine& rules, Deadline deadline) {
+  std::vector<SolverWorldModel::AttrUpdate> solns;
+  std::vector<uint32_t> changed;
+  world_model::grail_time now = world_model::getGRAILTime();
+  rules.drainDirty([&](uint32_t index, const RuleEngine::Output& rule, bool value) {
+      changed.push_back(index);
+      SolverWorldModel::AttrUpdate soln{utf8::decode(rule.solution), now, utf8::decode(rule.uri),
+                                        std::vector<uint8_t>()};
+      pushBackVal<uint8_t>(value ? 1 : 0, soln.data);
+      solns.push_back(soln);
+    });
+  try {
+    sendSolutions(swm, solns, deadline, true);
+  }
+  catch (std::runtime_error& err) {
+    for (uint32_t index : changed) {
+      rules.markDirty(index);
+    }
+    throw;
+  }
+}
+
+/**
+ * Publish every alert that was raised or cleared as the solution
+ * <solution>.alert of the sensor's object. Alerts stay queued if sending
+ * fails.
+ */
+void publishAlerts(SolverWorldModel& swm, const SensorTable& sensors, OpenAlerts& alerts, Deadline deadline) {
+  std::vector<SolverWorldModel::AttrUpdate> solns;
+  std::vector<size_t> slots;
+  world_model::grail_time now = world_model::getGRAILTime();
+  alerts.drain([&](size_t slot, bool raised) {
+      if (not sensors.inUse(slot)) {
+        return;
+      }
+      slots.push_back(slot);
+      std::string uri = sensors.uri(slot);
+      SolverWorldModel::AttrUpdate soln{utf8::decode(sensors.solution(slot) + ".alert"), now, utf8::decode(uri),
+                                        std::vector<uint8_t>()};
+      pushBackVal<uint8_t>(raised ? 1 : 0, soln.data);
+      solns.push_back(soln);
+      if (raised) {
+        std::cout<<uri<<" raised a "<<sensors.solution(slot)<<" alert\n";
+      }
+    });
+  try {
+    sendSolutions(swm, solns, deadline);
+  }
+  catch (std::runtime_error& err) {
+    for (size_t slot : slots) {
+      alerts.markDirty(slot);
+    }
+    throw;
+  }
+}
+
+/**
+ * Publish the sensors of each alert class that have been in the alerting
+ * state the longest as the solution <solution>.longest of the given object:
+ * a count followed by the object URI (a byte length and UTF-16 characters)
+ * and the time it entered the state of each sensor, longest first. Classes
+ * are only sent when their list changed since the last time.
+ */
+void publishLongest(SolverWorldModel& swm, const SensorTable& sensors, const OpenAlerts& alerts,
+                    size_t count, const URI& target, std::vector<std::vector<uint8_t>>& published) {
+  std::vector<SolverWorldModel::AttrUpdate> solns;
+  std::vector<size_t> classes;
+  world_model::grail_time now = world_model::getGRAILTime();
+  published.resize(alerts.classList().size());
+  for (size_t cls = 0; cls < alerts.classList().size(); ++cls) {
+    std::vector<uint8_t> data;
+    std::vector<std::pair<size_t, grail_time>> longest;
+    alerts.longest(cls, count, [&](size_t slot, int64_t since) { longest.push_back(std::make_pair(slot, since)); });
+    pushBackVal<uint32_t>(longest.size(), data);
+    for (std::pair<size_t, grail_time>& entry : longest) {
+      URI uri = utf8::decode(sensors.uri(entry.first));
+      pushBackVal<uint32_t>(uri.size() * sizeof(char16_t), data);
+      for (char16_t c : uri) {
+        pushBackVal<uint16_t>(c, data);
+      }
+      pushBackVal<grail_time>(entry.second, data);
+    }
+    if (data != published[cls]) {
+      solns.push_back(SolverWorldModel::AttrUpdate{utf8::decode(alerts.classList()[cls].solution + ".longest"), now,
+                                                   target, data});
+      classes.push_back(cls);
+    }
+  }
+  if (not solns.empty()) {
+    sendSolutions(swm, solns, Deadline::max(), true);
+  }
+  for (size_t i = 0; i < classes.size(); ++i) {
+    published[classes[i]] = solns[i].data;
+  }
+}
+
+/**
+ * Publish the transitions of the given slots as a single batch of solutions.
+ * Published transitions are then passed to the enabled sinks: recorded in
+ * the journal, left waiting in the ledger for acknowledgement, added to the
+ * time in state accumulators, counted in the group aggregates, fed to the
+ * rules, scheduled or cancelled as open too long alerts, kept in the
+ * sensor's history, sent to the change feed subscribers and appended to the
+ * shared memory change log. Throws std::runtime_error if sending fails.
+ * @param log_each Print a line for every transition.
+ */
+void sendTransitions(SolverWorldModel& swm, const SensorTable& sensors, const EnumSolutions& enums,
+                     const StateStore& states,
+                     const std::vector<size_t>& slots, const std::vector<grail_time>& sample_times,
+                     const TransitionSinks& sinks, bool log_each, Deadline deadline) {
+  std::vector<SolverWorldModel::AttrUpdate> solns;
+  solns.reserve(slots.size());
+  world_model::grail_time now = world_model::getGRAILTime();
+  for (size_t slot : slots) {
+    bool switch_on = states.get(slot);
+    std::string uri = sensors.uri(slot);
+    //Names are only converted to UTF-16 here, when they go on the wire
+    SolverWorldModel::AttrUpdate soln{utf8::decode(sensors.solution(slot)), now, utf8::decode(uri),
+                                      std::vector<uint8_t>()};
+    pushBackVal<uint8_t>(states.value(slot), soln.data);
+    solns.push_back(soln);
+    if (not log_each) {
+      continue;
+    }
+    if (2 < enums.states(slot)) {
+      std::cout<<uri<<' '<<sensors.solution(slot)<<" is "<<
+        enums.stateName(sensors.solution(slot), states.value(slot))<<'\n';
+    }
+    else if (switch_on) {
+      std::cout<<uri<<" is "<<sensors.solution(slot)<<'\n';
+    } else {
+      std::cout<<uri<<" is not "<<sensors.solution(slot)<<'\n';
+    }
+  }
+  //Send the data to the world model
+  sendSolutions(swm, solns, deadline);
+  for (size_t slot : slots) {
+    //Consumers of binary states see a sensor with more states as true
+    //when it is not in its first state
+    bool value = states.get(slot);
+    uint8_t state = states.value(slot);
+    if (sinks.journal) {
+      uint64_t sequence = sinks.journal->record(slot, state, sample_times[slot], now);
+      if (sinks.ledger) {
+        sinks.ledger->sent(sequence, sensors.uri(slot), sensors.solution(slot), now);
+      }
+    }
+    if (sinks.time_in_state) {
+      sinks.time_in_state->transition(slot, value, sample_times[slot]);
+    }
+    if (sinks.aggregates) {
+      sinks.aggregates->update(slot, value);
+    }
+    if (sinks.rules) {
+      sinks.rules->update(slot, value);
+    }
+    if (sinks.alerts) {
+      sinks.alerts->transition(slot, value, sample_times[slot]);
+    }
+    if (sinks.history) {
+      sinks.history->record(slot, value, sample_times[slot]);
+    }
+    if (sinks.change_log) {
+      sinks.change_log->append(slot, state, sample_times[slot]);
+    }
+    if (sinks.feed and 0 < sinks.feed->subscribers()) {
+      sinks.feed->append(now, sensors.uri(slot), sensors.solution(slot), state);
+    }
+  }
 }
 
-std::u16string toU16(const std::string& str) {
-  return std::u16string(str.begin(), str.end());
+/**
+ * Publish every sensor whose state changed since the last publish, one batch
+ * per priority lane, highest priority first. Sensors that the lanes hold
+ * back, or whose lane could not be sent, stay dirty so that they are
+ * published again later. Changed groups, rule results and cleared alerts
+ * are published after them. The pass is reported to the load shedder,
+ * which may shed lanes; while it does, changed groups and the per
+ * transition log lines are held back. Rule results and alerts are critical
+ * and are published at every level.
+ *
+ * The transitions of a pass are limited to the tokens in the rate limit
+ * bucket, and the others wait dirty for a later pass. Lanes above priority
+ * 0, groups, rules and alerts are always published and borrow their tokens.
+ * Sensors published less than their minimum interval ago are held by the
+ * throttle before they take any tokens, and marked dirty again when the
+ * interval ends. A sensor counts as published only once its lane was sent.
+ * @return The number of transitions sent.
+ */
+size_t publishChanges(SolverWorldModel& swm, const SensorTable& sensors, const EnumSolutions& enums,
+                      StateStore& states,
+                      const std::vector<grail_time>& sample_times, const TransitionSinks& sinks,
+                      PriorityLanes& lanes, LoadShedder& shedder, TokenBucket& bucket,
+                      PublishThrottle& throttle, Deadline deadline = Deadline::max()) {
+  bool normal = LoadShedder::normal == shedder.level();
+  size_t sent = 0;
+  grail_time now = world_model::getGRAILTime();
+  throttle.advance(now, states);
+  bucket.refill(std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+  //Held sensors are removed before the budget is spent on the lanes
+  PriorityLanes::Hold hold;
+  if (throttle.enabled()) {
+    hold = [&](std::vector<size_t>& slots) { throttle.filter(slots, now); };
+  }
+  if (0 < lanes.collect(states, bucket.available(), hold)) {
+    std::vector<PriorityLanes::Lane>& lane_list = lanes.laneList();
+    for (size_t lane = 0; lane < lane_list.size(); ++lane) {
+      std::vector<size_t>& slots = lane_list[lane].queued;
+      if (slots.empty()) {
+        continue;
+      }
+      try {
+        sendTransitions(swm, sensors, enums, states, slots, sample_times, sinks, normal, deadline);
+      }
+      catch (std::runtime_error& err) {
+        lanes.requeue(lane, states);
+        throw;
+      }
+      throttle.sent(slots, now);
+      lane_list[lane].sent += slots.size();
+      bucket.take(slots.size());
+      sent += slots.size();
+      slots.clear();
+    }
+    if (sinks.feed) {
+      sinks.feed->flush();
+    }
+  }
+  bucket.limited(lanes.lastLimited());
+  if (shedder.observe(now, lanes.lastWaiting(), lanes.heldBack())) {
+    lanes.shedBelow(shedder.shedBelow(), states);
+    std::cerr<<"Load is "<<LoadShedder::name(shedder.level())<<" with "<<lanes.lastWaiting()<<
+      " transitions waiting, "<<lanes.shedCount()<<" sensors shed\n";
+  }
+  if (normal and sinks.aggregates and 0 < sinks.aggregates->dirtyCount()) {
+    bucket.take(sinks.aggregates->dirtyCount());
+    publishAggregates(swm, *sinks.aggregates, deadline);
+  }
+  //Rules and alerts are few and urgent, so shedding never holds them back
+  if (sinks.rules and 0 < sinks.rules->dirtyCount()) {
+    bucket.take(sinks.rules->dirtyCount());
+    publishRules(swm, *sinks.rules, deadline);
+  }
+  if (sinks.alerts and 0 < sinks.alerts->pending()) {
+    bucket.take(sinks.alerts->pending());
+    publishAlerts(swm, sensors, *sinks.alerts, deadline);
+  }
+  return sent;
 }
 
-std::string toString(const std::u16string& str) {
-  return std::string(str.begin(), str.end());
+/**
+ * Republish the journaled transitions that the world model had not
+ * acknowledged when the solver stopped. They keep their original times, so
+ * a transition that did arrive is simply stored again.
+ * @return The number of transitions republished.
+ */
+size_t replayUnacknowledged(SolverWorldModel& swm, const std::string& journal_directory,
+                            PublishLedger& ledger) {
+  std::vector<SolverWorldModel::AttrUpdate> solns;
+  TransitionJournal::scan(journal_directory, ledger.checkpoint(), [&](const TransitionJournal::Transition& t) {
+      SolverWorldModel::AttrUpdate soln{utf8::decode(t.solution), t.publish_time, utf8::decode(t.uri),
+                                        std::vector<uint8_t>()};
+      pushBackVal<uint8_t>(t.value, soln.data);
+      solns.push_back(soln);
+      ledger.sent(t.sequence, t.uri, t.solution, t.publish_time);
+    });
+  if (not solns.empty()) {
+    sendSolutions(swm, solns);
+  }
+  return solns.size();
+}
+
+///Acknowledge our transitions that the world model reports as stored.
+void acknowledge(const world_model::WorldState& ws, const std::u16string& origin, PublishLedger& ledger) {
+  for (const std::pair<const URI, std::vector<Attribute>>& I : ws) {
+    for (const Attribute& attr : I.second) {
+      if (attr.origin == origin) {
+        ledger.acknowledge(utf8::encode(I.first), utf8::encode(attr.name), attr.creation_date);
+      }
+    }
+  }
+}
+
+/**
+ * Publish the time in state totals of every sensor that changed since the
+ * last time, in batches of solutions named after the sensor's solution.
+ * They borrow their tokens from the rate limit bucket.
+ */
+void publishTimeInState(SolverWorldModel& swm, const SensorTable& sensors, TimeInState& time_in_state,
+                        TokenBucket& bucket) {
+  const size_t batch_size = 4096;
+  std::vector<SolverWorldModel::AttrUpdate> solns;
+  world_model::grail_time now = world_model::getGRAILTime();
+  auto add = [&](const std::string& name, const URI& uri, std::vector<uint8_t>&& data) {
+    solns.push_back(SolverWorldModel::AttrUpdate{utf8::decode(name), now, uri, data});
+  };
+  time_in_state.drain(now, [&](size_t slot, const TimeInState::Totals& totals) {
+      if (not sensors.inUse(slot)) {
+        return;
+      }
+      URI uri = utf8::decode(sensors.uri(slot));
+      const std::string& solution = sensors.solution(slot);
+      std::vector<uint8_t> data;
+      pushBackVal<grail_time>(totals.since, data);
+      add(solution + ".since", uri, std::move(data));
+      data.clear();
+      pushBackVal<uint64_t>(totals.true_ms, data);
+      add(solution + ".time_true", uri, std::move(data));
+      data.clear();
+      pushBackVal<uint64_t>(totals.false_ms, data);
+      add(solution + ".time_false", uri, std::move(data));
+      data.clear();
+      pushBackVal<uint32_t>(totals.transitions, data);
+      add(solution + ".transitions", uri, std::move(data));
+      if (solns.size() >= batch_size) {
+        bucket.take(solns.size());
+        sendSolutions(swm, solns);
+        solns.clear();
+      }
+    });
+  if (not solns.empty()) {
+    bucket.take(solns.size());
+    sendSolutions(swm, solns);
+  }
+}
+
+//Scratch space for one batch of samples, reused between batches
+struct SampleBatch {
+  std::vector<uint32_t> slots;
+  std::vector<uint8_t> values;
+  std::vector<const URI*> keys;
+  std::vector<SensorTable::Slot> found;
+};
+
+//Consecutive samples that must agree before a sensor changes state
+struct Debounce {
+  //At most 255, one sample accepts every change
+  int threshold;
+  //Samples in a row of each slot that disagreed with its state
+  std::vector<uint8_t> streak;
+};
+
+/**
+ * Store the switch states of one world model update. Sensors whose state is
+ * new or changed are marked dirty in the state store, and the time of each
+ * sample is kept for the journal. A change is held back until the debounce
+ * threshold of samples in a row agree with it.
+ */
+void applySamples(const world_model::WorldState& ws, const SensorTable& sensors, const EnumSolutions& enums,
+                  StateStore& states,
+                  std::vector<grail_time>& sample_times, SampleBatch& batch, Debounce& debounce) {
+  //Resolve the slot of each object and gather its new switch state
+  batch.slots.clear();
+  batch.values.clear();
+  //Look up every transmitter in the batch together so that the
+  //table's cache misses overlap
+  batch.keys.clear();
+  for (const std::pair<const URI, std::vector<Attribute>>& I : ws) {
+    batch.keys.push_back(&I.first);
+  }
+  batch.found.resize(batch.keys.size());
+  sensors.findBatch(batch.keys.data(), batch.keys.size(), batch.found.data());
+  size_t sample = 0;
+  for (const std::pair<const URI, std::vector<Attribute>>& I : ws) {
+    SensorTable::Slot slot = batch.found[sample++];
+    if (SensorTable::no_slot != slot) {
+      //Get the first byte of the data, a binary value or the number of the
+      //state of a sensor with more states
+      uint8_t value = I.second[0].data.at(0);
+      uint8_t count = enums.states(slot);
+      if (2 == count) {
+        value = value ? 1 : 0;
+      }
+      //Ignore a state the solution does not have
+      else if (value >= count) {
+        continue;
+      }
+      batch.slots.push_back(slot);
+      batch.values.push_back(value);
+      sample_times[slot] = I.second[0].creation_date;
+    }
+  }
+  if (1 < debounce.threshold) {
+    debounce.streak.resize(states.size(), 0);
+    size_t kept = 0;
+    for (size_t i = 0; i < batch.slots.size(); ++i) {
+      uint32_t slot = batch.slots[i];
+      if (states.isKnown(slot) and states.value(slot) != batch.values[i] and
+          ++debounce.streak[slot] < debounce.threshold) {
+        continue;
+      }
+      debounce.streak[slot] = 0;
+      batch.slots[kept] = slot;
+      batch.values[kept] = batch.values[i];
+      ++kept;
+    }
+    batch.slots.resize(kept);
+    batch.values.resize(kept);
+  }
+  //Compare the whole batch against the stored states at once. Slots
+  //are marked dirty if they are new or if the value changed.
+  states.applyBatch(batch.slots, batch.values);
+}
+
+//What the admin socket commands can see and change
+struct AdminContext {
+  const SensorTable& sensors;
+  const EnumSolutions& enums;
+  const UriIndex& uris;
+  StateStore& states;
+  TransitionSinks& sinks;
+  const PriorityLanes& lanes;
+  const LoadShedder& shedder;
+  const TokenBucket& bucket;
+  const PublishThrottle& throttle;
+  //The sensor history, kept while recording is switched off
+  SensorHistory* history;
+  Debounce& debounce;
+  //Set to request the mappings again and republish every state
+  bool resync;
+};
+
+///The slots of a transmitter name, or else of every transmitter of an object URI.
+std::vector<SensorTable::Slot> findSlots(const SensorTable& sensors, const UriIndex& uris,
+                                         const std::string& name) {
+  SensorTable::Slot slot = sensors.find(name);
+  if (SensorTable::no_slot != slot) {
+    return std::vector<SensorTable::Slot>(1, slot);
+  }
+  std::vector<SensorTable::Slot> slots;
+  uris.forExact(name, [&](size_t s) { slots.push_back(s); });
+  if (slots.empty()) {
+    throw std::invalid_argument("no transmitter or object named " + name);
+  }
+  return slots;
+}
+
+const char* admin_help =
+  "stats                   sensor, publish and memory statistics\n"
+  "lookup NAME             mapping and state of a transmitter or of the transmitters of an object\n"
+  "slot N                  mapping and state of a sensor slot, as in the change log\n"
+  "under PREFIX [N]        the number of objects whose URI starts with PREFIX and the first N (default 20)\n"
+  "history NAME [N]        the last N (default 10) transitions of each sensor\n"
+  "at NAME TIME            the state of each sensor at a GRAIL time in milliseconds\n"
+  "resync                  request every mapping again and republish every state\n"
+  "threshold [N]           show or set the samples in a row needed to change state\n"
+  "record on|off           switch the recording of sensor history\n";
+
+///Run one admin socket command on the ingest thread and return its reply.
+std::string adminCommand(const std::string& line, AdminContext& admin) {
+  std::istringstream in(line);
+  std::string command;
+  in>>command;
+  std::ostringstream out;
+  if ("" == command or "help" == command) {
+    out<<admin_help;
+  }
+  else if ("stats" == command) {
+    out<<"sensors "<<admin.sensors.size()<<" of "<<admin.sensors.capacity()<<" slots, "<<
+      admin.uris.size()<<" indexed by URI\n";
+    out<<"names "<<admin.sensors.stringBytes()<<" bytes\n";
+    out<<"unpublished "<<admin.states.dirtyCount()<<'\n';
+    out<<"threshold "<<admin.debounce.threshold<<'\n';
+    if (admin.sinks.journal) {
+      out<<"journal next "<<admin.sinks.journal->nextSequence()<<" durable "<<
+        admin.sinks.journal->durableSequence()<<'\n';
+    }
+    if (admin.sinks.ledger) {
+      out<<"unacknowledged "<<admin.sinks.ledger->inFlight()<<" in a window of "<<
+        admin.sinks.ledger->windowSize()<<" from "<<admin.sinks.ledger->checkpoint()<<'\n';
+    }
+    if (admin.sinks.aggregates) {
+      out<<"groups "<<admin.sinks.aggregates->size()<<'\n';
+    }
+    if (admin.sinks.rules) {
+      out<<"rules "<<admin.sinks.rules->rules().size()<<" nodes "<<admin.sinks.rules->nodeCount()<<'\n';
+    }
+    for (const PriorityLanes::Lane& lane : admin.lanes.laneList()) {
+      out<<"lane "<<lane.priority<<" sent "<<lane.sent<<" deferred "<<lane.deferred<<" shed "<<lane.shed<<'\n';
+    }
+    for (const PublishThrottle::Class& cls : admin.throttle.classList()) {
+      out<<"interval "<<cls.solution<<' '<<cls.interval_ms<<"ms held "<<cls.held<<'\n';
+    }
+    if (admin.throttle.enabled()) {
+      out<<"held "<<admin.throttle.heldCount()<<'\n';
+    }
+    if (admin.bucket.enabled()) {
+      out<<"rate limit "<<admin.bucket.ratePerSecond()<<"/s sent "<<admin.bucket.taken()<<
+        " waited "<<admin.bucket.limitedCount()<<'\n';
+    }
+    if (admin.shedder.enabled()) {
+      out<<"load "<<LoadShedder::name(admin.shedder.level())<<" events "<<admin.shedder.events()<<
+        " shed "<<admin.lanes.shedCount()<<" sensors\n";
+    }
+    if (admin.sinks.alerts) {
+      for (const OpenAlerts::Class& cls : admin.sinks.alerts->classList()) {
+        out<<"open "<<cls.solution<<' '<<cls.heap.size()<<'\n';
+      }
+    }
+    if (admin.sinks.change_log) {
+      out<<"change log next "<<admin.sinks.change_log->nextSequence()<<'\n';
+    }
+    if (admin.sinks.feed) {
+      out<<"feed subscribers "<<admin.sinks.feed->subscribers()<<'\n';
+    }
+    if (admin.history) {
+      out<<"history "<<(admin.sinks.history ? "on " : "off ")<<admin.history->bytesUsed()<<" of "<<
+        admin.history->bytesLimit()<<" bytes, "<<admin.history->droppedTransitions()<<" not recorded\n";
+    }
+  }
+  else if ("lookup" == command or "slot" == command or "history" == command or "at" == command) {
+    std::string name;
+    in>>name;
+    int64_t number = -1;
+    if (not (in>>number)) {
+      number = "history" == command ? 10 : -1;
+    }
+    if ("at" == command and 0 > number) {
+      throw std::invalid_argument("at needs a time");
+    }
+    if (("history" == command or "at" == command) and not admin.history) {
+      throw std::invalid_argument("history is not kept, start with --history-mb");
+    }
+    std::vector<SensorTable::Slot> slots;
+    if ("slot" == command) {
+      SensorTable::Slot slot = std::stoul(name);
+      if (not admin.sensors.inUse(slot)) {
+        throw std::invalid_argument("slot " + name + " is not in use");
+      }
+      slots.push_back(slot);
+    }
+    else {
+      slots = findSlots(admin.sensors, admin.uris, name);
+    }
+    for (SensorTable::Slot slot : slots) {
+      out<<admin.sensors.transmitter(slot)<<' '<<admin.sensors.uri(slot)<<' '<<admin.sensors.solution(slot);
+      if ("lookup" == command or "slot" == command) {
+        out<<" slot "<<slot<<' ';
+        if (not admin.states.isKnown(slot)) {
+          out<<"unknown";
+        }
+        else if (2 < admin.enums.states(slot)) {
+          out<<admin.enums.stateName(admin.sensors.solution(slot), admin.states.value(slot));
+        }
+        else {
+          out<<(admin.states.get(slot) ? "on" : "off");
+        }
+        out<<(admin.states.isDirty(slot) ? " unpublished" : "")<<'\n';
+      }
+      else if ("history" == command) {
+        out<<'\n';
+        admin.history->recent(slot, number, [&](int64_t time, bool value) {
+            out<<"  "<<time<<' '<<(value ? "on" : "off")<<'\n';
+          });
+      }
+      else {
+        SensorHistory::State state = admin.history->stateAt(slot, number);
+        if (state.known) {
+          out<<' '<<(state.value ? "on" : "off")<<" since "<<state.since;
+          if (0 != state.until) {
+            out<<" until "<<state.until;
+          }
+          out<<'\n';
+        }
+        else {
+          out<<" unknown\n";
+        }
+      }
+    }
+  }
+  else if ("under" == command) {
+    std::string prefix;
+    size_t limit = 20;
+    in>>prefix;
+    if (not (in>>limit)) {
+      limit = 20;
+    }
+    size_t count = 0;
+    admin.uris.forPrefix(prefix, [&](size_t slot) {
+        if (count++ < limit) {
+          out<<admin.sensors.uri(slot)<<' '<<admin.sensors.solution(slot)<<' '<<admin.sensors.transmitter(slot)<<'\n';
+        }
+        return true;
+      });
+    out<<count<<" sensors\n";
+  }
+  else if ("resync" == command) {
+    admin.resync = true;
+    out<<"republishing "<<admin.states.markKnownDirty()<<" states\n";
+  }
+  else if ("threshold" == command) {
+    int threshold = 0;
+    if (in>>threshold) {
+      if (1 > threshold or 255 < threshold) {
+        throw std::invalid_argument("the threshold must be from 1 to 255");
+      }
+      admin.debounce.threshold = threshold;
+      admin.debounce.streak.assign(admin.debounce.streak.size(), 0);
+    }
+    out<<"threshold "<<admin.debounce.threshold<<'\n';
+  }
+  else if ("record" == command) {
+    std::string mode;
+    in>>mode;
+    if (not admin.history) {
+      throw std::invalid_argument("history is not kept, start with --history-mb");
+    }
+    if ("on" != mode and "off" != mode) {
+      throw std::invalid_argument("record needs on or off");
+    }
+    admin.sinks.history = "on" == mode ? admin.history : nullptr;
+    out<<"recording "<<mode<<'\n';
+  }
+  else {
+    throw std::invalid_argument("unknown command " + command + ", try help");
+  }
+  return out.str();
+}
+
+//Passes over the responses to spin through in busy poll mode before sleeping
+const unsigned int default_spin_budget = 100000;
+//Time allowed to flush pending changes when shutting down
+const int default_drain_ms = 5000;
+//Time between saves of the acknowledged journal position
+const int default_checkpoint_ms = 1000;
+//Length of the time in state accumulation window, one day
+const int default_time_in_state_window_s = 86400;
+//Number of longest open sensors published per alert class
+const int default_longest_open = 20;
+//Time between publishes of the longest open sensors
+const int default_longest_open_ms = 1000;
+//Transitions held by the shared memory change log
+const int default_change_log_entries = 1 << 20;
+//Options that take an integer value
+const char* const integer_options[] = {"expected-sensors", "idle-wait-ms", "drain-ms", "journal-sync-ms",
+	"journal-segment-mb", "checkpoint-ms", "time-in-state-ms", "time-in-state-window-s", "aggregate-depth",
+	"longest-open", "longest-open-ms", "history-mb", "feed-queue-kb", "change-log-entries", "lane-batch",
+	"shed-waiting", "shed-age-ms", "shed-recover-ms", "max-updates-per-s", "update-burst"};
+
+/**
+ * Print the arguments and options of the solver.
+ */
+void printUsage(const char* program) {
+	std::cerr<<"\t"<<program<<" <world model ip> <solver port> <client port> [options]\n\n";
+	std::cerr<<"This solver uses binary data from objects with attributes named ";
+	std::cerr<<"'sensor.door' and 'sensor.water'.\n";
+	std::cerr<<"An optional 4th argument may be an integer specifying the number of times a binary value\n";
+	std::cerr<<"must be observed before a state change occurs. Use this to combat packet errors. Try setting\n";
+	std::cerr<<"this to one less than the expected number of receivers that can see a transmitter's packet.\n\n";
+	std::cerr<<"Options:\n";
+	std::cerr<<"\t--low-latency\t\tBack the sensor tables with huge pages and lock all memory\n";
+	std::cerr<<"\t--expected-sensors=N\tSize the sensor tables for N transmitters at startup\n";
+	std::cerr<<"\t--pin-<role>=CPUS\tPin a thread role (ingest, ...) to a cpu list such as 2,4-5\n";
+	std::cerr<<"\t--fifo-<role>=PRIO\tRun a thread role with SCHED_FIFO priority PRIO\n";
+	std::cerr<<"\t--busy-poll[=SPINS]\tSpin on the world model responses before sleeping\n";
+	std::cerr<<"\t--idle-wait-ms=MS\tLongest time to sleep when there is no data (default 1)\n";
+	std::cerr<<"\t--reactor=BACKEND\tauto (default), epoll, or io_uring\n";
+	std::cerr<<"\t--snapshot=FILE\t\tSave sensor states to FILE on shutdown and restore them on startup\n";
+	std::cerr<<"\t--drain-ms=MS\t\tTime allowed to publish pending changes on shutdown (default 5000)\n";
+	std::cerr<<"\t--journal=DIR\t\tRecord every published transition in a durable journal in DIR\n";
+	std::cerr<<"\t--journal-sync-ms=MS\tLongest time between journal syncs, 0 to sync every write (default 0)\n";
+	std::cerr<<"\t--journal-segment-mb=MB\tSize of each journal segment file (default 64)\n";
+	std::cerr<<"\t--checkpoint-ms=MS\tTime between saves of the acknowledged journal position (default 1000)\n";
+	std::cerr<<"\t--time-in-state-ms=MS\tPublish time in state and transition counts every MS\n";
+	std::cerr<<"\t--time-in-state-window-s=S\tLength of the time in state window (default 86400, one day)\n";
+	std::cerr<<"\t--aggregate\t\tPublish state counts for each URI prefix of the objects\n";
+	std::cerr<<"\t--aggregate-depth=N\tOnly count the first N levels of each URI (default all)\n";
+	std::cerr<<"\t--aggregate-separator=C\tCharacter between URI levels (default .)\n";
+	std::cerr<<"\t--group-<prefix>=GROUP\tCount objects whose URI starts with prefix in GROUP instead\n";
+	std::cerr<<"\t--rule-<uri>:<solution>=EXPR\tPublish solution of uri as the result of a rule (see README)\n";
+	std::cerr<<"\t--open-alert-<solution>=MS\tAlert when a door is open or a water sensor wet for MS\n";
+	std::cerr<<"\t--longest-open=K\tPublish the K sensors of each alert class open the longest (default 20)\n";
+	std::cerr<<"\t--longest-open-uri=URI\tObject to publish the longest open sensors on (default binary_state_solver)\n";
+	std::cerr<<"\t--longest-open-ms=MS\tTime between publishes of the longest open sensors (default 1000)\n";
+	std::cerr<<"\t--history-mb=MB\t\tKeep the recent transitions of each sensor in up to MB of memory\n";
+	std::cerr<<"\t--admin-socket=PATH\tAccept operator commands on a Unix domain socket (see README)\n";
+	std::cerr<<"\t--feed-socket=PATH\tSend every published transition to subscribers on a Unix domain socket\n";
+	std::cerr<<"\t--feed-queue-kb=KB\tMost data queued for one feed subscriber (default 1024)\n";
+	std::cerr<<"\t--feed-overflow=POLICY\tdrop (default) or disconnect a feed subscriber that falls behind\n";
+	std::cerr<<"\t--change-log=FILE\tAppend every published transition to a shared memory ring in FILE\n";
+	std::cerr<<"\t--change-log-entries=N\tNumber of transitions the change log holds (default 1048576)\n";
+	std::cerr<<"\t--priority-<solution>=N\tPublish solution in a lane of priority N, higher first (default 0)\n";
+	std::cerr<<"\t--lane-batch=N\t\tMost transitions of a priority 0 or lower lane sent at once (default all)\n";
+	std::cerr<<"\t--shed-waiting=N\t\tShed low priority lanes when more than N transitions wait\n";
+	std::cerr<<"\t--shed-age-ms=MS\t\tShed low priority lanes when a transition waited longer than MS\n";
+	std::cerr<<"\t--shed-recover-ms=MS\tHow long the lanes must keep up before shedding stops (default 1000)\n";
+	std::cerr<<"\t--max-updates-per-s=N\tSend at most N updates per second to the world model (default no limit)\n";
+	std::cerr<<"\t--update-burst=N\t\tUpdates that may be sent at once under the limit (default N per second)\n";
+	std::cerr<<"\t--min-interval-<solution>=MS\tPublish each sensor of solution at most once every MS\n";
+	std::cerr<<"\t--states-<solution>=A,B,..\tSolution with up to 16 named states from attribute sensor.<solution>\n";
+	std::cerr<<"\t--config=FILE\t\tRead options from FILE, one 'name value' pair per line\n";
 }
 
 int main(int arg_count, char** arg_vector) {
@@ -89,60 +883,337 @@ int main(int arg_count, char** arg_vector) {
     return 0;
   }
 
-  if (4 > arg_count) {
-    std::cerr<<"This program needs 4 arguments:\n";
-		std::cerr<<"\t"<<arg_vector[0]<<" <world model ip> <solver port> <client port>\n\n";
-		std::cerr<<"This solver uses binary data from objects with attributes named ";
-		std::cerr<<"'sensor.door' and 'sensor.water'.\n";
-		std::cerr<<"An optional 4th argument may be an integer specifying the number of times a binary value\n";
-	  std::cerr<<"must be observed before a state change occurs. Use this to combat packet errors. Try setting\n";
-	  std::cerr<<"this to one less than the expected number of receivers that can see a transmitter's packet.\n";
+  Options options(arg_count, arg_vector);
+  const std::vector<std::string>& args = options.arguments();
+
+  if (3 > args.size()) {
+    std::cerr<<"This program needs 3 arguments:\n";
+    printUsage(arg_vector[0]);
     return 0;
   }
 
-  //Set up a signal handler to catch interrupt signals so we can close gracefully
-  signal(SIGINT, handler);  
+	//Check every integer option before anything is set up, so that a typo
+	//stops the solver with the usage instead of part way through starting
+	try {
+		for (const char* name : integer_options) {
+			options.getInt(name, 0);
+		}
+		for (const std::string prefix : {"open-alert-", "min-interval-"}) {
+			for (auto& option : options.withPrefix(prefix)) {
+				options.getInt(prefix + option.first, 0);
+			}
+		}
+	}
+	catch (std::invalid_argument& err) {
+		std::cerr<<err.what()<<"\n\n";
+		printUsage(arg_vector[0]);
+		return 0;
+	}
+
+  //Receive SIGINT and SIGTERM through the event loop so that we can drain and
+  //close gracefully. This must come before any thread is started.
+  ShutdownSignals shutdown;
 
   //World model IP and ports
-  std::string wm_ip(arg_vector[1]);
-  int solver_port = std::stoi(std::string((arg_vector[2])));
-  int client_port = std::stoi(std::string((arg_vector[3])));
-	int transition_threshold = 1;
-	if (arg_count == 5) {
-		transition_threshold = std::stoi(std::string((arg_vector[4])));
-		std::cerr<<"Using a transition threshold of "<<transition_threshold<<'\n';
+  std::string wm_ip(args[0]);
+  int solver_port = std::stoi(args[1]);
+  int client_port = std::stoi(args[2]);
+	Debounce debounce{1, std::vector<uint8_t>()};
+	if (args.size() == 4) {
+		debounce.threshold = std::max(1, std::min(255, std::stoi(args[3])));
+		std::cerr<<"Using a transition threshold of "<<debounce.threshold<<'\n';
 	}
 
+	//The low latency profile must be on before the sensor tables are allocated
+	if (options.has("low-latency")) {
+		if (not huge_pages::enableLowLatency()) {
+			std::cerr<<"Could not lock memory for the low latency profile: "<<strerror(errno)<<'\n';
+		}
+	}
+	size_t expected_sensors = options.getInt("expected-sensors", 0);
+
+	//Pin this thread, which ingests and publishes samples, to its cores
+	std::unique_ptr<ThreadPlacement> placement;
+	try {
+		placement.reset(new ThreadPlacement(options));
+	}
+	catch (std::invalid_argument& err) {
+		std::cerr<<err.what()<<", check the --pin-<role> and --fifo-<role> options\n";
+		return 0;
+	}
+	placement->apply(ThreadPlacement::ingest);
+
   //Set up the solver world model connection;
   std::string origin = "binary_state_solver";
 
   //Remember what names correspond to what solutions and build a
   //query to find all objects of interest.
   //Use the object to solution map to map transmitters to URIs
-  std::map<std::u16string, std::u16string> object_to_solution;
-	object_to_solution[u"sensor.door"] = u"closed";
-	object_to_solution[u"sensor.water"] = u"wet";
+  std::map<std::u16string, std::string> object_to_solution;
+	object_to_solution[u"sensor.door"] = "closed";
+	object_to_solution[u"sensor.water"] = "wet";
+	//Solutions with more than two states, driven by attributes named after them
+	EnumSolutions enums;
+	try {
+		for (auto& solution : options.withPrefix("states-")) {
+			enums.add(solution.first, solution.second);
+			object_to_solution[u"sensor." + utf8::decode(solution.first)] = solution.first;
+		}
+	}
+	catch (std::invalid_argument& err) {
+		std::cerr<<err.what()<<'\n';
+		return 0;
+	}
 
-	//Map of transmitter URI (with binary data type) to object URIs.
-  std::map<URI, URI> tx_to_uri;
-  std::map<URI, std::u16string> tx_to_solution;
+	//Map of transmitter URI (with binary data type) to a sensor slot, which
+	//remembers the object URI and solution name of the transmitter.
+  SensorTable sensors;
+  sensors.reserve(expected_sensors);
+	//The slots under each URI prefix
+	UriIndex uri_index;
+
+	//States published before the last shutdown
+	StateSnapshot snapshot;
+	std::string snapshot_path = options.get("snapshot", "");
+	bool have_snapshot = false;
+	try {
+		have_snapshot = not snapshot_path.empty() and snapshot.load(snapshot_path);
+	}
+	catch (std::runtime_error& err) {
+		//A bad snapshot only costs republishing every state
+		std::cerr<<err.what()<<", starting without it\n";
+	}
+	if (have_snapshot) {
+		std::cerr<<"Loaded "<<snapshot.size()<<" sensor states from "<<snapshot_path<<'\n';
+		//Without a journal the snapshot cannot be brought up to date after a
+		//crash, so it is only good for this one restart
+		if (not options.has("journal")) {
+			unlink(snapshot_path.c_str());
+		}
+	}
 
   //Solution types for the world model.
-  std::vector<std::pair<std::u16string, bool>> solution_types{{u"closed", false}, {u"wet", false}};
+  std::vector<std::u16string> solutions{u"closed", u"wet"};
+  for (auto& solution : enums.solutions()) {
+    solutions.push_back(utf8::decode(solution.first));
+  }
+  std::vector<std::pair<std::u16string, bool>> solution_types;
+  for (const std::u16string& solution : solutions) {
+    solution_types.push_back(std::make_pair(solution, false));
+  }
+
+	//Time spent in each state and transition counts, published as derived
+	//attributes of every solution
+	std::unique_ptr<TimeInState> time_in_state;
+	int time_in_state_ms = options.getInt("time-in-state-ms", 0);
+	if (0 < time_in_state_ms) {
+		time_in_state.reset(new TimeInState(
+			int64_t(options.getInt("time-in-state-window-s", default_time_in_state_window_s)) * 1000));
+		for (const std::u16string& solution : solutions) {
+			for (const std::u16string& suffix : {u".since", u".time_true", u".time_false", u".transitions"}) {
+				solution_types.push_back(std::make_pair(solution + suffix, false));
+			}
+		}
+	}
+	Deadline next_time_in_state = std::chrono::steady_clock::now();
+
+	//Per group counts of each solution, published as solutions of the groups
+	std::unique_ptr<GroupAggregates> aggregates;
+	std::map<std::string, std::string> explicit_groups = options.withPrefix("group-");
+	if (options.has("aggregate") or not explicit_groups.empty()) {
+		std::string separator = options.get("aggregate-separator", ".");
+		if (1 != separator.size()) {
+			std::cerr<<"--aggregate-separator must be a single character\n";
+			return 0;
+		}
+		aggregates.reset(new GroupAggregates(separator[0], options.getInt("aggregate-depth", 0)));
+		for (auto& group : explicit_groups) {
+			aggregates->setGroup(group.first, group.second);
+		}
+		for (const std::u16string& solution : solutions) {
+			solution_types.push_back(std::make_pair(solution + u".count", false));
+			solution_types.push_back(std::make_pair(solution + u".count_true", false));
+		}
+	}
+
+	//Derived states from rules over the sensor states, compiled once here
+	std::unique_ptr<RuleEngine> rules;
+	std::map<std::string, std::string> rule_options = options.withPrefix("rule-");
+	if (not rule_options.empty()) {
+		rules.reset(new RuleEngine());
+		try {
+			for (auto& rule : rule_options) {
+				size_t colon = rule.first.rfind(':');
+				if (std::string::npos == colon or 0 == colon or rule.first.size() - 1 == colon) {
+					throw std::invalid_argument("Rule --rule-" + rule.first + " must be named <uri>:<solution>");
+				}
+				std::string solution = rule.first.substr(colon + 1);
+				rules->addRule(rule.first.substr(0, colon), solution, rule.second);
+				std::pair<std::u16string, bool> type(utf8::decode(solution), false);
+				if (solution_types.end() == std::find(solution_types.begin(), solution_types.end(), type)) {
+					solution_types.push_back(type);
+				}
+			}
+			rules->compile();
+		}
+		catch (std::invalid_argument& err) {
+			std::cerr<<err.what()<<'\n';
+			return 0;
+		}
+		std::cerr<<"Compiled "<<rules->rules().size()<<" rules into "<<rules->nodeCount()<<" nodes\n";
+	}
+
+	//Alerts for doors left open and water sensors left wet too long, and the
+	//sensors in those states the longest
+	std::unique_ptr<OpenAlerts> alerts;
+	std::map<std::string, std::string> alert_options = options.withPrefix("open-alert-");
+	size_t longest_open = options.getInt("longest-open", default_longest_open);
+	URI longest_open_uri = utf8::decode(options.get("longest-open-uri", origin));
+	int longest_open_ms = options.getInt("longest-open-ms", default_longest_open_ms);
+	Deadline next_longest_open = std::chrono::steady_clock::now();
+	std::vector<std::vector<uint8_t>> published_longest;
+	if (not alert_options.empty()) {
+		alerts.reset(new OpenAlerts());
+		for (auto& alert : alert_options) {
+			//A door alerts while it is not closed, anything else while it is true
+			alerts->addClass(alert.first, "closed" != alert.first, options.getInt("open-alert-" + alert.first, 0));
+			solution_types.push_back(std::make_pair(utf8::decode(alert.first + ".alert"), false));
+			solution_types.push_back(std::make_pair(utf8::decode(alert.first + ".longest"), false));
+		}
+	}
 
   std::cerr<<"Trying to connect to world model as a solver.\n";
-  SolverWorldModel swm(wm_ip, solver_port, solution_types, toU16(origin));
+  SolverWorldModel swm(wm_ip, solver_port, solution_types, utf8::decode(origin));
   if (not swm.connected()) {
     std::cerr<<"Could not connect to the world model as a solver - aborting.\n";
     return 0;
   }
 
-	//Remember switch states so that we only update when something changes
-  std::map<URI, bool> switch_state;
+	//Durable record of every published transition, written in the background
+	std::unique_ptr<TransitionJournal> journal;
+	//Journaled transitions that the world model has not acknowledged yet
+	std::unique_ptr<PublishLedger> ledger;
+	std::string journal_directory = options.get("journal", "");
+	if (not journal_directory.empty()) {
+		TransitionJournal::Config config{journal_directory, int(options.getInt("journal-sync-ms", 0)),
+			size_t(options.getInt("journal-segment-mb", 64)) * 1024 * 1024};
+		//Running without the journal that was asked for would lose transitions
+		//silently, so a journal that cannot be used stops the solver
+		try {
+			journal.reset(new TransitionJournal(config, [&placement]() { placement->apply("journal"); }));
+			std::cerr<<"Journaling transitions to "<<journal_directory<<" from sequence "<<journal->nextSequence()<<'\n';
+			if (have_snapshot) {
+				size_t applied = snapshot.rollForward(journal_directory);
+				std::cerr<<"Applied "<<applied<<" journaled transitions to the snapshot\n";
+			}
+			//Only the transitions after the checkpoint may be missing from the world model
+			ledger.reset(new PublishLedger(journal_directory + "/checkpoint"));
+			size_t replayed = replayUnacknowledged(swm, journal_directory, *ledger);
+			std::cerr<<"Republished "<<replayed<<" unacknowledged transitions from sequence "<<ledger->checkpoint()<<'\n';
+		}
+		catch (std::runtime_error& err) {
+			std::cerr<<"Could not use the journal in "<<journal_directory<<": "<<err.what()<<'\n';
+			return 0;
+		}
+	}
+	int checkpoint_ms = options.getInt("checkpoint-ms", default_checkpoint_ms);
+	Deadline next_checkpoint = std::chrono::steady_clock::now();
+	//Recent transitions of each sensor, in bounded memory
+	std::unique_ptr<SensorHistory> history;
+	if (0 < options.getInt("history-mb", 0)) {
+		history.reset(new SensorHistory(size_t(options.getInt("history-mb", 0)) * 1024 * 1024));
+	}
+	//Published transitions for local subscribers, written by a background thread
+	std::unique_ptr<ChangeFeed> feed;
+	std::string feed_path = options.get("feed-socket", "");
+	if (not feed_path.empty()) {
+		std::string policy = options.get("feed-overflow", "drop");
+		if ("drop" != policy and "disconnect" != policy) {
+			std::cerr<<"--feed-overflow must be drop or disconnect\n";
+			return 0;
+		}
+		try {
+			feed.reset(new ChangeFeed(feed_path, size_t(options.getInt("feed-queue-kb", 1024)) * 1024,
+				"drop" == policy ? ChangeFeed::Overflow::drop : ChangeFeed::Overflow::disconnect,
+				[&placement]() { placement->apply("feed"); }));
+			std::cerr<<"Sending transitions to subscribers on "<<feed_path<<'\n';
+		}
+		catch (std::runtime_error& err) {
+			//Local readers are not worth stopping the solver for
+			std::cerr<<err.what()<<", running without the change feed\n";
+		}
+	}
+	//Published transitions for local readers that tail shared memory
+	std::unique_ptr<ChangeLog> change_log;
+	std::string change_log_path = options.get("change-log", "");
+	if (not change_log_path.empty()) {
+		try {
+			change_log.reset(new ChangeLog(change_log_path, options.getInt("change-log-entries", default_change_log_entries)));
+			std::cerr<<"Appending transitions to "<<change_log_path<<" from sequence "<<change_log->nextSequence()<<'\n';
+		}
+		catch (std::runtime_error& err) {
+			std::cerr<<err.what()<<", running without the change log\n";
+		}
+	}
+	TransitionSinks sinks{journal.get(), ledger.get(), time_in_state.get(), aggregates.get(), rules.get(),
+		alerts.get(), history.get(), feed.get(), change_log.get()};
+	//Outbound lanes by solution priority, so urgent solutions are not sent
+	//behind a storm of others
+	std::map<std::string, int> priorities;
+	try {
+		for (auto& priority : options.withPrefix("priority-")) {
+			priorities[priority.first] = std::stoi(priority.second);
+		}
+	}
+	catch (std::logic_error& err) {
+		std::cerr<<"--priority-<solution> needs an integer priority\n";
+		return 0;
+	}
+	PriorityLanes lanes(priorities, options.getInt("lane-batch", 0));
+	//Shed the low priority lanes in steps when the backlog keeps growing
+	LoadShedder shedder(LoadShedder::Config{size_t(options.getInt("shed-waiting", 0)),
+		options.getInt("shed-age-ms", 0), options.getInt("shed-recover-ms", 1000)});
+	//Limit the updates sent to the world model per second, by default with
+	//a burst of a second's worth
+	int max_updates = options.getInt("max-updates-per-s", 0);
+	TokenBucket bucket(max_updates, options.getInt("update-burst", max_updates));
+	//Publish the sensors of some solutions at most once per interval
+	PublishThrottle throttle;
+	for (auto& interval : options.withPrefix("min-interval-")) {
+		throttle.addClass(interval.first, options.getInt("min-interval-" + interval.first, 0));
+	}
+
+	//Remember switch states, one bit per sensor slot, so that we only update
+	//when something changes
+  StateStore states;
+  if (not enums.empty()) {
+    states.setValueBits(enums.valueBits());
+  }
+  states.resize(expected_sensors);
+	//Time of the latest sample of each slot
+	std::vector<grail_time> sample_times(states.size());
+	if (time_in_state) {
+		time_in_state->resize(states.size());
+	}
+	if (alerts) {
+		alerts->resize(states.size());
+	}
+	lanes.resize(states.size());
+	throttle.resize(states.size());
+	enums.resize(states.size());
+  if (huge_pages::lowLatency()) {
+    std::cerr<<huge_pages::report()<<'\n';
+  }
+  std::cerr<<"Using the "<<state_kernels::kernelName()<<" state comparison kernel\n";
+	SampleBatch batch;
 
   //Search for sensor attributes of any matching IDs
 	URI desired_ids = u".*";
-  std::vector<URI> attributes{u"sensor.(door|water)"};
+  URI attribute_pattern = u"sensor.(door|water";
+  for (auto& solution : enums.solutions()) {
+    attribute_pattern += u"|" + utf8::decode(solution.first);
+  }
+  std::vector<URI> attributes{attribute_pattern + u")"};
 
 	//Update IDs one a second
 	world_model::grail_time interval = 1000;
@@ -153,6 +1224,30 @@ int main(int arg_count, char** arg_vector) {
 	std::vector<URI> binary_attributes{u"binary state"};
 	world_model::grail_time binary_interval = 0;
 
+	//The event loop, which also delivers the shutdown signals
+	std::unique_ptr<Reactor> reactor = Reactor::create(options.get("reactor", "auto"));
+	std::cerr<<"Using the "<<reactor->name()<<" reactor\n";
+	shutdown.watch(*reactor);
+
+	//Operator commands, read by a background thread and run between batches
+	AdminContext admin_context{sensors, enums, uri_index, states, sinks, lanes, shedder, bucket, throttle, history.get(), debounce, false};
+	std::unique_ptr<AdminSocket> admin;
+	std::string admin_path = options.get("admin-socket", "");
+	if (not admin_path.empty()) {
+		try {
+			admin.reset(new AdminSocket(admin_path, [&placement]() { placement->apply("admin"); }));
+			admin->watch(*reactor);
+			std::cerr<<"Accepting admin commands on "<<admin_path<<'\n';
+		}
+		catch (std::runtime_error& err) {
+			std::cerr<<err.what()<<", running without the admin socket\n";
+			admin.reset();
+		}
+	}
+	AdminSocket::Handler admin_handler = [&admin_context](const std::string& line) {
+		return adminCommand(line, admin_context);
+	};
+
 	//We will connect to the world model as a client inside of the processing loop below
 	//Whenever we are disconnected we will attempt to reconnect.
 
@@ -161,105 +1256,199 @@ int main(int arg_count, char** arg_vector) {
 	//Send out the requests
 	StepResponse sr = cwc.streamRequest(desired_ids, attributes, interval);
 	StepResponse binary_response = cwc.streamRequest(binary_ids, binary_attributes, binary_interval);
+	//Our own transition solutions as the world model stores them acknowledge
+	//what we sent. Derived attributes are not in the ledger.
+	URI ack_ids = u".*";
+	std::vector<URI> ack_attributes(solutions.begin(), solutions.end());
+	std::unique_ptr<StepResponse> ack_response;
+	if (ledger) {
+		ack_response.reset(new StepResponse(cwc.streamRequest(ack_ids, ack_attributes, 0)));
+	}
+
+	//Without data the loop either spins on the responses for a bounded number
+	//of passes (busy poll mode) or goes straight to sleeping in the reactor.
+	unsigned int spin_budget = 0;
+	if (options.has("busy-poll")) {
+		//A bare --busy-poll uses the default budget
+		std::string spins = options.get("busy-poll", "");
+		if (not spins.empty()) {
+			try {
+				spin_budget = std::stoul(spins);
+			}
+			catch (std::logic_error& err) {
+				std::cerr<<"--busy-poll needs a number of passes\n";
+				return 0;
+			}
+		}
+		if (0 == spin_budget) {
+			spin_budget = default_spin_budget;
+		}
+		std::cerr<<"Busy polling for up to "<<spin_budget<<" passes before sleeping\n";
+	}
+	IdlePolicy idle_policy(spin_budget, options.getInt("idle-wait-ms", 1));
 
 	std::cerr<<"Starting processing loop...\n";
-  while (not interrupted) {
+  while (not shutdown.requested()) {
+		bool did_work = false;
 		//Less than operator for two world model attributes
 		auto attr_comp = [](const Attribute& a, const Attribute& b) {
 			return (a.expiration_date != 0 or a.creation_date < b.creation_date); };
 		//Stay connected
-    while (not cwc.connected() and not interrupted) {
+    while (not cwc.connected() and not shutdown.requested()) {
       std::cerr<<"Waiting 4 seconds before attempting to reconnect client->world model connection\n";
-      //Sleep for several seconds after an error before trying to reconnect
-      sleep(4);
+      //Sleep for several seconds after an error before trying to reconnect,
+      //waking up early for a shutdown
+      reactor->wait(4000);
+      if (shutdown.requested()) {
+        break;
+      }
+			if (admin) {
+				admin->serve(admin_handler);
+			}
       cwc.reconnect();
 			if (cwc.connected()) {
 				//Re-send out the requests
-				StepResponse sr = cwc.streamRequest(desired_ids, attributes, interval);
-				StepResponse binary_response = cwc.streamRequest(binary_ids, binary_attributes, binary_interval);
+				sr = cwc.streamRequest(desired_ids, attributes, interval);
+				binary_response = cwc.streamRequest(binary_ids, binary_attributes, binary_interval);
+				if (ledger) {
+					*ack_response = cwc.streamRequest(ack_ids, ack_attributes, 0);
+				}
 			}
     }
 
 		try {
 
 			//Now process the on-demand binary data
-			while (binary_response.hasNext() and not interrupted) {
+			while (binary_response.hasNext() and not shutdown.requested()) {
 				//Get world model updates
 				world_model::WorldState ws = binary_response.next();
-				//Check each object for new switch states
-				for (const std::pair<URI, std::vector<Attribute>>& I : ws) {
-					if (tx_to_uri.end() != tx_to_uri.find(I.first)) {
-						URI uri = tx_to_uri[I.first];
-						std::u16string soln_name = tx_to_solution[I.first];
-						//Get the first byte of the data (will be a one byte binary value)
-						bool switch_on = I.second[0].data.at(0);
-						//Update if this is new or if the value changed
-						if (switch_state.end() == switch_state.find(uri) or switch_state[uri] != switch_on) {
-							switch_state[uri] = switch_on;
-							//Use the object to solution map to get the solution name.
-							SolverWorldModel::AttrUpdate soln{soln_name, world_model::getGRAILTime(), uri, std::vector<uint8_t>()};
-							pushBackVal<uint8_t>(switch_on ? 1 : 0, soln.data);
-							std::vector<SolverWorldModel::AttrUpdate> solns{soln};
-							//Send the data to the world model
-							bool retry = true;
-							while (retry) {
-								try {
-									retry = false;
-									swm.sendData(solns, false);
-								}
-								catch (std::runtime_error& err) {
-									//Retry if this is just a temporary socket error
-									if (err.what() == std::string("Error sending data over socket: Resource temporarily unavailable")) {
-										std::cerr<<"Experiencing socket slow down with world model connection. Retrying...\n";
-										retry = true;
-									}
-									//Otherwise keep throwing
-									else {
-										throw err;
-									}
-								}
-							}
-							if (switch_on) {
-								std::cout<<toString(uri)<<" is "<<toString(soln_name)<<'\n';
-							} else {
-								std::cout<<toString(uri)<<" is not "<<toString(soln_name)<<'\n';
-							}
-						}
-					}
+				did_work = true;
+				applySamples(ws, sensors, enums, states, sample_times, batch, debounce);
+				//Send out everything that changed in this batch, lane by lane
+				publishChanges(swm, sensors, enums, states, sample_times, sinks, lanes, shedder, bucket, throttle);
+			}
+			//Send what the lanes held back once the input has been read and the
+			//sensors whose minimum interval ended, and let the load shedder see
+			//when the lanes have caught up
+			if ((lanes.heldBack() or 0 < throttle.heldCount() or LoadShedder::normal != shedder.level()) and
+			    not shutdown.requested()) {
+				//Waiting for rate limit tokens is not work
+				if (0 < publishChanges(swm, sensors, enums, states, sample_times, sinks, lanes, shedder, bucket, throttle)) {
+					did_work = true;
 				}
 			}
+			//Acknowledge transitions that the world model now has
+			while (ack_response and ack_response->hasNext() and not shutdown.requested()) {
+				acknowledge(ack_response->next(), utf8::decode(origin), *ledger);
+				did_work = true;
+			}
 			//Check for responses to map sensors to object identifiers
-			while (sr.hasNext() and not interrupted) {
+			while (sr.hasNext() and not shutdown.requested()) {
 				std::cerr<<"Got sensor name data\n";
 				//Get world model updates
 				world_model::WorldState ws = sr.next();
+				did_work = true;
 				//Check each object for switch sensor ID information
 				for (const std::pair<URI, std::vector<Attribute>>& I : ws) {
 					if (I.second.empty()) {
-						std::cerr<<toString(I.first)<<" is an empty object.\n";
+						std::cerr<<utf8::encode(I.first)<<" is an empty object.\n";
 					}
 					else {
 						Attribute newest = *(std::max_element(I.second.begin(), I.second.end(), attr_comp));
 
 						//Transmitters are stored as one byte of physical layer and 16 bytes of ID
 						grail_types::transmitter tx_switch = grail_types::readTransmitter(newest.data);
-						std::string str = std::to_string(tx_switch.phy) + "." + std::to_string(tx_switch.id.lower);
-						std::u16string tx_str = std::u16string(str.begin(), str.end());
+						std::string tx_str = std::to_string(tx_switch.phy) + "." + std::to_string(tx_switch.id.lower);
+						std::string uri = utf8::encode(I.first);
 						if (newest.expiration_date != 0) {
 							//This attribute has been expired so stop updating the
 							//status of this ID in the world model
-							tx_to_uri.erase(tx_str);
-							tx_to_solution.erase(tx_str);
+							SensorTable::Slot slot = sensors.find(tx_str);
+							if (SensorTable::no_slot != slot) {
+								if (ledger) {
+									//Nothing more will be acknowledged for this sensor
+									ledger->acknowledge(sensors.uri(slot), sensors.solution(slot), INT64_MAX);
+								}
+								sensors.erase(tx_str);
+								uri_index.remove(slot);
+								states.forget(slot);
+								if (time_in_state) {
+									time_in_state->forget(slot);
+								}
+								if (aggregates) {
+									aggregates->forget(slot);
+								}
+								if (rules) {
+									rules->forget(slot);
+								}
+								if (alerts) {
+									alerts->forget(slot);
+								}
+								if (history) {
+									history->forget(slot);
+								}
+								throttle.forget(slot);
+							}
 						}
 						else {
 							//Otherwise, make sure that we have signed up for this sensor's data
 							//from the aggregators
 
 							//Map this transmitter to the ID of the object it corresponds to in the world model
-							tx_to_uri[tx_str] = I.first;
-							//Map this transmitter ID to a solution type from its attribute name
-							tx_to_solution[tx_str] = object_to_solution[newest.name];
-							std::cerr<<"Adding "<<std::string(I.first.begin(), I.first.end())<<" into object map with transmitter "<<std::string(str)<<"\n";
+							//and to a solution type from its attribute name
+							bool changed = false;
+							SensorTable::Slot slot = sensors.assign(tx_str, uri, object_to_solution[newest.name], changed);
+							states.resize(sensors.capacity());
+							sample_times.resize(states.size());
+							if (time_in_state) {
+								time_in_state->resize(states.size());
+							}
+							if (alerts) {
+								alerts->resize(states.size());
+							}
+							lanes.resize(states.size());
+							throttle.resize(states.size());
+							enums.resize(states.size());
+							if (changed) {
+								//The previous state belonged to a different object or solution
+								states.forget(slot);
+								if (time_in_state) {
+									time_in_state->forget(slot);
+								}
+								uri_index.add(slot, uri);
+								if (journal) {
+									journal->name(slot, uri, sensors.solution(slot));
+								}
+								if (aggregates) {
+									aggregates->assign(slot, uri, sensors.solution(slot));
+								}
+								if (rules) {
+									rules->assign(slot, uri, sensors.solution(slot));
+								}
+								if (alerts) {
+									alerts->assign(slot, sensors.solution(slot));
+								}
+								lanes.assign(slot, sensors.solution(slot));
+								throttle.assign(slot, sensors.solution(slot));
+								enums.assign(slot, sensors.solution(slot));
+								if (history) {
+									history->forget(slot);
+								}
+								//The world model may already have this sensor's state
+								if (snapshot.restore(sensors, slot, states)) {
+									if (aggregates) {
+										aggregates->update(slot, states.get(slot));
+									}
+									if (rules) {
+										rules->update(slot, states.get(slot));
+									}
+									//The time it entered the state was not saved, so start it now
+									if (alerts) {
+										alerts->transition(slot, states.get(slot), world_model::getGRAILTime());
+									}
+								}
+							}
+							std::cerr<<"Adding "<<uri<<" into object map with transmitter "<<tx_str<<"\n";
 						}
 					}
 				}
@@ -268,6 +1457,125 @@ int main(int arg_count, char** arg_vector) {
 		catch (std::runtime_error& err) {
 			std::cerr<<"Error in client->world model connection: "<<err.what()<<'\n';
 		}
+		if (admin and admin->pending()) {
+			admin->serve(admin_handler);
+			did_work = true;
+		}
+		//Ask for every mapping again and republish every state
+		if (admin_context.resync and cwc.connected()) {
+			admin_context.resync = false;
+			std::cerr<<"Resynchronizing with the world model\n";
+			try {
+				sr = cwc.streamRequest(desired_ids, attributes, interval);
+				publishChanges(swm, sensors, enums, states, sample_times, sinks, lanes, shedder, bucket, throttle);
+			}
+			catch (std::runtime_error& err) {
+				std::cerr<<"Error resynchronizing: "<<err.what()<<'\n';
+			}
+		}
+		//A busy loop may not reach the reactor, so look for signals directly
+		if (did_work) {
+			shutdown.check();
+		}
+		idle_policy.idle(did_work, *reactor);
+
+		//Save how far the world model has acknowledged, but never past what
+		//the journal has made durable
+		if (ledger and std::chrono::steady_clock::now() >= next_checkpoint) {
+			try {
+				ledger->save(journal->durableSequence());
+			}
+			catch (std::runtime_error& err) {
+				std::cerr<<err.what()<<'\n';
+			}
+			next_checkpoint = std::chrono::steady_clock::now() + std::chrono::milliseconds(checkpoint_ms);
+		}
+		//Publish the derived time in state attributes in one batch per cadence,
+		//unless load is being shed
+		if (time_in_state and LoadShedder::normal == shedder.level() and
+		    std::chrono::steady_clock::now() >= next_time_in_state) {
+			try {
+				publishTimeInState(swm, sensors, *time_in_state, bucket);
+			}
+			catch (std::runtime_error& err) {
+				std::cerr<<"Error publishing time in state: "<<err.what()<<'\n';
+			}
+			next_time_in_state = std::chrono::steady_clock::now() + std::chrono::milliseconds(time_in_state_ms);
+		}
+		//Raise the alerts whose deadlines passed and refresh the longest open lists
+		if (alerts) {
+			try {
+				alerts->advance(world_model::getGRAILTime());
+				if (0 < alerts->pending()) {
+					publishAlerts(swm, sensors, *alerts, Deadline::max());
+				}
+				if (0 < longest_open and LoadShedder::normal == shedder.level() and
+				    std::chrono::steady_clock::now() >= next_longest_open) {
+					next_longest_open = std::chrono::steady_clock::now() + std::chrono::milliseconds(longest_open_ms);
+					publishLongest(swm, sensors, *alerts, longest_open, longest_open_uri, published_longest);
+				}
+			}
+			catch (std::runtime_error& err) {
+				std::cerr<<"Error publishing alerts: "<<err.what()<<'\n';
+			}
+		}
   }
+
+	//Process the data that already arrived and publish every pending change
+	Deadline deadline = std::chrono::steady_clock::now() +
+		std::chrono::milliseconds(options.getInt("drain-ms", default_drain_ms));
+	try {
+		while (binary_response.hasNext() and std::chrono::steady_clock::now() < deadline) {
+			applySamples(binary_response.next(), sensors, enums, states, sample_times, batch, debounce);
+		}
+		//Shed and held sensors get their latest state sent too
+		lanes.shedBelow(INT_MIN, states);
+		throttle.stop(states);
+		do {
+			//Wait for rate limit tokens instead of spinning
+			if (0 == publishChanges(swm, sensors, enums, states, sample_times, sinks, lanes, shedder, bucket, throttle, deadline)) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		} while (lanes.heldBack() and std::chrono::steady_clock::now() < deadline);
+		//Keep whatever is still shed unpublished in the snapshot
+		lanes.shedBelow(INT_MIN, states);
+		//Wait for the world model to acknowledge what is in flight
+		while (ledger and 0 < ledger->inFlight() and std::chrono::steady_clock::now() < deadline) {
+			while (ack_response->hasNext()) {
+				acknowledge(ack_response->next(), utf8::decode(origin), *ledger);
+			}
+			reactor->wait(1);
+		}
+	}
+	catch (std::runtime_error& err) {
+		std::cerr<<"Error draining before shutdown: "<<err.what()<<'\n';
+	}
+	if (0 < states.dirtyCount()) {
+		std::cerr<<states.dirtyCount()<<" changes could not be published before shutdown\n";
+	}
+	if (journal) {
+		journal->sync();
+		try {
+			ledger->save(journal->durableSequence());
+		}
+		catch (std::runtime_error& err) {
+			std::cerr<<err.what()<<'\n';
+		}
+		if (0 < ledger->inFlight()) {
+			std::cerr<<ledger->inFlight()<<" transitions will be republished after the restart\n";
+		}
+	}
+
+	//Save what the world model now has so that a restart does not republish it
+	if (not snapshot_path.empty()) {
+		try {
+			size_t saved = StateSnapshot::write(snapshot_path, sensors, states, journal ? journal->nextSequence() : 0);
+			std::cerr<<"Saved "<<saved<<" sensor states to "<<snapshot_path<<'\n';
+		}
+		catch (std::runtime_error& err) {
+			std::cerr<<err.what()<<'\n';
+		}
+	}
+	return 0;
 }
 
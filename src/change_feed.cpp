@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "change_feed.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <limits.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "admin_socket.hpp"
+
+namespace {
+  //Longest filter line accepted from a subscriber
+  const size_t max_line = 4096;
+
+  void clearEventfd(int fd) {
+    uint64_t count;
+    while (sizeof(count) == read(fd, &count, sizeof(count)));
+  }
+}
+
+ChangeFeed::ChangeFeed(const std::string& path, size_t max_queue_bytes, Overflow overflow,
+                       std::function<void()> on_start) :
+  path(path), max_queue_bytes(max_queue_bytes), overflow(overflow), listen_fd(-1), wake_fd(-1), stop_fd(-1),
+  on_start(on_start), subscriber_count(0), current(new Batch()) {
+  listen_fd = AdminSocket::listenUnix(path);
+  wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (0 > wake_fd or 0 > stop_fd) {
+    std::string error = strerror(errno);
+    //The caller may carry on without us, so leave no socket behind
+    for (int fd : {listen_fd, wake_fd, stop_fd}) {
+      if (0 <= fd) {
+        close(fd);
+      }
+    }
+    unlink(path.c_str());
+    throw std::runtime_error("Could not create an eventfd: " + error);
+  }
+  server = std::thread(&ChangeFeed::run, this);
+}
+
+ChangeFeed::~ChangeFeed() {
+  uint64_t one = 1;
+  if (sizeof(one) != write(stop_fd, &one, sizeof(one))) {
+    std::cerr<<"Could not stop the change feed thread\n";
+  }
+  server.join();
+  close(listen_fd);
+  close(wake_fd);
+  close(stop_fd);
+  unlink(path.c_str());
+}
+
+void ChangeFeed::append(int64_t time, const std::string& uri, const std::string& solution, uint8_t value) {
+  if (0 == subscribers()) {
+    return;
+  }
+  Batch& batch = *current;
+  Batch::Event event;
+  event.offset = batch.data.size();
+  batch.data.append(std::to_string(time));
+  batch.data.push_back(' ');
+  event.uri_offset = batch.data.size();
+  event.uri_length = uri.size();
+  batch.data.append(uri);
+  batch.data.push_back(' ');
+  event.solution_offset = batch.data.size();
+  event.solution_length = solution.size();
+  batch.data.append(solution);
+  batch.data.push_back(' ');
+  batch.data.append(std::to_string(int(value)));
+  batch.data.push_back('\n');
+  event.length = batch.data.size() - event.offset;
+  batch.events.push_back(event);
+}
+
+void ChangeFeed::flush() {
+  if (current->events.empty()) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    handed_off.push_back(current);
+  }
+  current.reset(new Batch());
+  uint64_t one = 1;
+  if (sizeof(one) != write(wake_fd, &one, sizeof(one))) {
+    std::cerr<<"Could not wake the change feed thread\n";
+  }
+}
+
+bool ChangeFeed::matches(const Subscriber& subscriber, const Batch& batch, const Batch::Event& event) {
+  if (not subscriber.prefixes.empty() and subscriber.prefixes.end() == std::find_if(
+        subscriber.prefixes.begin(), subscriber.prefixes.end(), [&](const std::string& prefix) {
+          return prefix.size() <= event.uri_length and
+            0 == batch.data.compare(event.uri_offset, prefix.size(), prefix); })) {
+    return false;
+  }
+  return subscriber.solutions.empty() or subscriber.solutions.end() != std::find_if(
+      subscriber.solutions.begin(), subscriber.solutions.end(), [&](const std::string& solution) {
+        return 0 == batch.data.compare(event.solution_offset, event.solution_length, solution); });
+}
+
+bool ChangeFeed::deliver(Subscriber& subscriber, const std::shared_ptr<const Batch>& batch) {
+  for (const Batch::Event& event : batch->events) {
+    if (not matches(subscriber, *batch, event)) {
+      continue;
+    }
+    std::shared_ptr<Batch> notice;
+    if (0 < subscriber.dropped) {
+      notice.reset(new Batch());
+      notice->data = "dropped " + std::to_string(subscriber.dropped) + "\n";
+    }
+    size_t needed = event.length + (notice ? notice->data.size() : 0);
+    if (subscriber.queued_bytes + needed > max_queue_bytes) {
+      if (Overflow::disconnect == overflow) {
+        return false;
+      }
+      ++subscriber.dropped;
+      continue;
+    }
+    if (notice) {
+      subscriber.queue.push_back(Range{notice, 0, notice->data.size()});
+      subscriber.dropped = 0;
+    }
+    //Neighbouring events of the same batch are written as one range
+    if (not subscriber.queue.empty() and subscriber.queue.back().batch == batch and
+        subscriber.queue.back().offset + subscriber.queue.back().length == event.offset) {
+      subscriber.queue.back().length += event.length;
+    }
+    else {
+      subscriber.queue.push_back(Range{batch, event.offset, event.length});
+    }
+    subscriber.queued_bytes += needed;
+  }
+  return true;
+}
+
+void ChangeFeed::readFilters(Subscriber& subscriber, const std::string& data) {
+  subscriber.partial_line.append(data);
+  size_t end;
+  while (std::string::npos != (end = subscriber.partial_line.find('\n'))) {
+    std::string line = subscriber.partial_line.substr(0, end);
+    subscriber.partial_line.erase(0, end + 1);
+    if (not line.empty() and '\r' == line.back()) {
+      line.pop_back();
+    }
+    if (0 == line.compare(0, 7, "prefix ")) {
+      subscriber.prefixes.push_back(line.substr(7));
+    }
+    else if (0 == line.compare(0, 9, "solution ")) {
+      subscriber.solutions.push_back(line.substr(9));
+    }
+    else if ("all" == line) {
+      subscriber.prefixes.clear();
+      subscriber.solutions.clear();
+    }
+  }
+  if (subscriber.partial_line.size() > max_line) {
+    subscriber.partial_line.clear();
+  }
+}
+
+bool ChangeFeed::writeQueued(int fd, Subscriber& subscriber) {
+  while (not subscriber.queue.empty()) {
+    iovec iov[IOV_MAX];
+    size_t count = 0;
+    for (auto I = subscriber.queue.begin(); I != subscriber.queue.end() and count < IOV_MAX; ++I, ++count) {
+      iov[count].iov_base = const_cast<char*>(I->batch->data.data() + I->offset);
+      iov[count].iov_len = I->length;
+    }
+    ssize_t wrote = writev(fd, iov, count);
+    if (0 > wrote) {
+      return EAGAIN == errno or EWOULDBLOCK == errno or EINTR == errno;
+    }
+    subscriber.queued_bytes -= wrote;
+    while (0 < wrote) {
+      Range& range = subscriber.queue.front();
+      if (size_t(wrote) < range.length) {
+        range.offset += wrote;
+        range.length -= wrote;
+        break;
+      }
+      wrote -= range.length;
+      subscriber.queue.pop_front();
+    }
+  }
+  return true;
+}
+
+void ChangeFeed::run() {
+  if (on_start) {
+    on_start();
+  }
+  std::map<int, Subscriber> clients;
+  std::vector<std::shared_ptr<const Batch>> batches;
+  while (true) {
+    std::vector<pollfd> polls{pollfd{stop_fd, POLLIN, 0}, pollfd{wake_fd, POLLIN, 0}, pollfd{listen_fd, POLLIN, 0}};
+    for (auto& client : clients) {
+      polls.push_back(pollfd{client.first, short(POLLIN | (client.second.queue.empty() ? 0 : POLLOUT)), 0});
+    }
+    if (0 > poll(polls.data(), polls.size(), -1)) {
+      if (EINTR == errno) {
+        continue;
+      }
+      std::cerr<<"Change feed poll failed: "<<strerror(errno)<<'\n';
+      break;
+    }
+    if (polls[0].revents) {
+      break;
+    }
+    std::vector<int> closed;
+    if (polls[1].revents) {
+      clearEventfd(wake_fd);
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        batches.swap(handed_off);
+      }
+      for (auto& client : clients) {
+        bool keep = true;
+        for (size_t i = 0; keep and i < batches.size(); ++i) {
+          keep = deliver(client.second, batches[i]);
+          if (not keep) {
+            std::cerr<<"Disconnecting a change feed subscriber that fell behind\n";
+          }
+        }
+        //Most subscribers keep up, so try to write right away
+        if (not keep or not writeQueued(client.first, client.second)) {
+          closed.push_back(client.first);
+        }
+      }
+      batches.clear();
+    }
+    if (polls[2].revents & POLLIN) {
+      int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (0 <= fd) {
+        clients[fd] = Subscriber{std::string(), {}, {}, {}, 0, 0};
+        subscriber_count.store(clients.size(), std::memory_order_relaxed);
+      }
+    }
+    for (size_t i = 3; i < polls.size(); ++i) {
+      int fd = polls[i].fd;
+      auto I = clients.find(fd);
+      if (0 == polls[i].revents or clients.end() == I) {
+        continue;
+      }
+      bool keep = true;
+      if (polls[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+        char buff[1024];
+        ssize_t got = recv(fd, buff, sizeof(buff), 0);
+        if (0 < got) {
+          readFilters(I->second, std::string(buff, got));
+        }
+        else if (0 == got or (EAGAIN != errno and EINTR != errno)) {
+          keep = false;
+        }
+      }
+      if (keep and (polls[i].revents & POLLOUT)) {
+        keep = writeQueued(fd, I->second);
+      }
+      if (not keep) {
+        closed.push_back(fd);
+      }
+    }
+    for (int fd : closed) {
+      if (clients.erase(fd)) {
+        close(fd);
+      }
+    }
+    subscriber_count.store(clients.size(), std::memory_order_relaxed);
+  }
+  for (auto& client : clients) {
+    close(client.first);
+  }
+}
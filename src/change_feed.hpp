@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file change_feed.hpp
+ * A feed of published transitions for local subscribers on a Unix domain
+ * socket, so that local services do not each need their own world model
+ * streams for the same data.
+ *
+ * Each transition is one text line, "<time> <uri> <solution> <state>",
+ * where the state is 0 or 1, or the number of the state of a sensor with
+ * more than two states. A subscriber narrows the feed by sending lines of
+ * its own: "prefix P" to only receive objects whose URI starts with one of
+ * its prefixes, "solution S" to only receive some solutions, and "all" to
+ * clear both.
+ *
+ * The publishing thread encodes the transitions of one publish into a
+ * shared batch, once however many subscribers there are, and hands it to a
+ * background thread. That thread queues the ranges of the batch that match
+ * each subscriber's filter and writes them with writev. A subscriber's
+ * queue is bounded: past the limit new events are either dropped, followed
+ * by a "dropped N" line once there is room again, or the subscriber is
+ * disconnected.
+ ******************************************************************************/
+
+#ifndef __CHANGE_FEED_HPP__
+#define __CHANGE_FEED_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ChangeFeed {
+  public:
+    ///What to do with a subscriber whose queue is full.
+    enum class Overflow {drop, disconnect};
+
+  private:
+    //The encoded events of one publish
+    struct Batch {
+      struct Event {
+        uint32_t offset;
+        uint32_t length;
+        uint32_t uri_offset;
+        uint32_t uri_length;
+        uint32_t solution_offset;
+        uint32_t solution_length;
+      };
+      std::string data;
+      std::vector<Event> events;
+    };
+
+    //Part of a batch waiting to be written to a subscriber
+    struct Range {
+      std::shared_ptr<const Batch> batch;
+      size_t offset;
+      size_t length;
+    };
+
+    struct Subscriber {
+      std::string partial_line;
+      std::vector<std::string> prefixes;
+      std::vector<std::string> solutions;
+      std::deque<Range> queue;
+      size_t queued_bytes;
+      size_t dropped;
+    };
+
+    std::string path;
+    size_t max_queue_bytes;
+    Overflow overflow;
+    int listen_fd;
+    int wake_fd;
+    int stop_fd;
+    std::function<void()> on_start;
+    std::atomic<size_t> subscriber_count;
+
+    //Batch being filled by the publishing thread
+    std::shared_ptr<Batch> current;
+    std::mutex lock;
+    std::vector<std::shared_ptr<const Batch>> handed_off;
+    std::thread server;
+
+    ChangeFeed(const ChangeFeed&) = delete;
+    ChangeFeed& operator=(const ChangeFeed&) = delete;
+
+    static bool matches(const Subscriber& subscriber, const Batch& batch, const Batch::Event& event);
+    ///Queue the matching events of a batch for a subscriber.
+    ///@return false if the subscriber overflowed and must be disconnected.
+    bool deliver(Subscriber& subscriber, const std::shared_ptr<const Batch>& batch);
+    void readFilters(Subscriber& subscriber, const std::string& data);
+    ///@return false if the subscriber's connection failed.
+    bool writeQueued(int fd, Subscriber& subscriber);
+    void run();
+
+  public:
+    /**
+     * Listen for subscribers on a Unix domain socket at path and start the
+     * background thread, which calls on_start first.
+     * @param max_queue_bytes The most data queued for one subscriber.
+     * Throws std::runtime_error if the socket cannot be created.
+     */
+    ChangeFeed(const std::string& path, size_t max_queue_bytes, Overflow overflow,
+               std::function<void()> on_start = std::function<void()>());
+    ~ChangeFeed();
+
+    ///Number of connected subscribers.
+    size_t subscribers() const { return subscriber_count.load(std::memory_order_relaxed); }
+
+    ///Add a transition to the current batch. Does nothing without subscribers.
+    void append(int64_t time, const std::string& uri, const std::string& solution, uint8_t value);
+
+    ///Hand the current batch to the subscribers.
+    void flush();
+};
+
+#endif //__CHANGE_FEED_HPP__
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "change_log.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const char ChangeLog::magic[8] = {'B', 'S', 'S', 'R', 'I', 'N', 'G', '1'};
+
+void* ChangeLog::map(int fd, size_t bytes, bool writable) {
+  void* mem = mmap(nullptr, bytes, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+  if (MAP_FAILED == mem) {
+    return nullptr;
+  }
+  return mem;
+}
+
+ChangeLog::ChangeLog(const std::string& path, size_t capacity) : path(path), header(nullptr), records(nullptr) {
+  size_t rounded = 2;
+  while (rounded < capacity) {
+    rounded *= 2;
+  }
+  mask = rounded - 1;
+  bytes = sizeof(Header) + rounded * sizeof(Record);
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  struct stat info;
+  if (0 > fd or 0 != fstat(fd, &info)) {
+    throw std::runtime_error("Could not open change log " + path + ": " + strerror(errno));
+  }
+  bool reuse = size_t(info.st_size) == bytes;
+  if (not reuse and (0 != ftruncate(fd, 0) or 0 != ftruncate(fd, bytes))) {
+    std::string error = strerror(errno);
+    close(fd);
+    throw std::runtime_error("Could not size change log " + path + ": " + error);
+  }
+  void* mem = map(fd, bytes, true);
+  close(fd);
+  if (nullptr == mem) {
+    throw std::runtime_error("Could not map change log " + path + ": " + strerror(errno));
+  }
+  header = static_cast<Header*>(mem);
+  records = reinterpret_cast<Record*>(header + 1);
+  //Keep the sequence numbers of a ring of the same shape so readers can resume
+  if (not reuse or 0 != memcmp(header->magic, magic, sizeof(magic)) or rounded != header->capacity or
+      sizeof(Record) != header->record_size or 0 == header->next_sequence.load()) {
+    memset(mem, 0, bytes);
+    header->capacity = rounded;
+    header->record_size = sizeof(Record);
+    header->next_sequence.store(1);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, magic, sizeof(magic));
+  }
+}
+
+ChangeLog::~ChangeLog() {
+  munmap(header, bytes);
+}
+
+ChangeLog::Reader::Reader(const std::string& path) : bytes(0), header(nullptr), records(nullptr), mask(0) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if (0 > fd or 0 != fstat(fd, &info)) {
+    throw std::runtime_error("Could not open change log " + path + ": " + strerror(errno));
+  }
+  bytes = info.st_size;
+  void* mem = bytes >= sizeof(Header) ? map(fd, bytes, false) : nullptr;
+  close(fd);
+  if (nullptr == mem) {
+    throw std::runtime_error("Could not map change log " + path);
+  }
+  header = static_cast<const Header*>(mem);
+  records = reinterpret_cast<const Record*>(header + 1);
+  mask = header->capacity - 1;
+  if (0 != memcmp(header->magic, magic, sizeof(magic)) or sizeof(Record) != header->record_size or
+      bytes != sizeof(Header) + header->capacity * sizeof(Record)) {
+    munmap(mem, bytes);
+    throw std::runtime_error(path + " is not a change log");
+  }
+}
+
+ChangeLog::Reader::~Reader() {
+  munmap(const_cast<Header*>(header), bytes);
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file change_log.hpp
+ * A ring of published transitions in a shared memory file that local
+ * processes can tail without any system call per event.
+ *
+ * The file holds a header with the next sequence number followed by a
+ * power of two number of fixed size records, each holding its sequence
+ * number, the sensor slot, the state and the sample time. The solver is the
+ * only writer. A record is written like a seqlock: its sequence number is
+ * cleared, the fields are written and the sequence number is stored last,
+ * so a reader that sees the same expected sequence number before and after
+ * copying a record has a consistent copy. A reader that finds a newer
+ * sequence number has been overrun and can continue from the oldest record
+ * still in the ring. Sequence numbers continue across restarts of the
+ * solver, so readers can resume where they left off.
+ *
+ * Slots are the solver's sensor slots; the admin socket's slot command
+ * names the transmitter and object of a slot.
+ ******************************************************************************/
+
+#ifndef __CHANGE_LOG_HPP__
+#define __CHANGE_LOG_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class ChangeLog {
+  public:
+    ///A transition read from the ring.
+    struct Entry {
+      uint64_t sequence;
+      uint32_t slot;
+      ///The state, the number of the state for sensors with more than two.
+      uint8_t value;
+      int64_t time;
+    };
+
+  private:
+    struct Header {
+      char magic[8];
+      uint64_t capacity;
+      uint64_t record_size;
+      char pad[40];
+      //Sequence number of the next record, on its own cache line
+      std::atomic<uint64_t> next_sequence;
+      char pad2[56];
+    };
+    static_assert(sizeof(Header) == 128, "The change log header must be two cache lines");
+
+    struct Record {
+      //0 while the record is being written
+      std::atomic<uint64_t> sequence;
+      int64_t time;
+      uint32_t slot;
+      uint8_t value;
+    };
+
+    static const char magic[8];
+
+    std::string path;
+    size_t bytes;
+    Header* header;
+    Record* records;
+    uint64_t mask;
+
+    ChangeLog(const ChangeLog&) = delete;
+    ChangeLog& operator=(const ChangeLog&) = delete;
+
+    ///Map a ring file, checking its header if it is not new.
+    static void* map(int fd, size_t bytes, bool writable);
+
+  public:
+    /**
+     * Open the ring file at path for writing, creating it or resetting it
+     * if it does not have the given number of records, which is rounded up
+     * to a power of two.
+     * Throws std::runtime_error if the file cannot be created or mapped.
+     */
+    ChangeLog(const std::string& path, size_t capacity);
+    ~ChangeLog();
+
+    ///Append a transition. No system call is made.
+    void append(uint32_t slot, uint8_t value, int64_t time) {
+      uint64_t sequence = header->next_sequence.load(std::memory_order_relaxed);
+      Record& record = records[sequence & mask];
+      record.sequence.store(0, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      record.time = time;
+      record.slot = slot;
+      record.value = value;
+      record.sequence.store(sequence, std::memory_order_release);
+      header->next_sequence.store(sequence + 1, std::memory_order_release);
+    }
+
+    ///Sequence number of the next transition.
+    uint64_t nextSequence() const { return header->next_sequence.load(std::memory_order_relaxed); }
+
+    ///Tails a ring from another process.
+    class Reader {
+      private:
+        size_t bytes;
+        const Header* header;
+        const Record* records;
+        uint64_t mask;
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+      public:
+        enum Result {ok, not_yet, overrun};
+
+        /**
+         * Map a ring file read only.
+         * Throws std::runtime_error if it cannot be mapped or is not a ring.
+         */
+        Reader(const std::string& path);
+        ~Reader();
+
+        ///Sequence number of the next transition to be written.
+        uint64_t next() const { return header->next_sequence.load(std::memory_order_acquire); }
+
+        ///Sequence number of the oldest transition still in the ring.
+        uint64_t oldest() const {
+          uint64_t end = next();
+          return end > mask + 1 ? end - mask : 1;
+        }
+
+        /**
+         * Copy the transition with the given sequence number.
+         * @return ok, not_yet if it was not written yet, or overrun if it
+         *         was already overwritten.
+         */
+        Result read(uint64_t sequence, Entry& entry) const {
+          const Record& record = records[sequence & mask];
+          uint64_t before = record.sequence.load(std::memory_order_acquire);
+          entry.sequence = sequence;
+          entry.time = record.time;
+          entry.slot = record.slot;
+          entry.value = record.value;
+          std::atomic_thread_fence(std::memory_order_acquire);
+          uint64_t after = record.sequence.load(std::memory_order_relaxed);
+          if (before == sequence and after == sequence) {
+            return ok;
+          }
+          //A record being rewritten or newer than expected means the
+          //writer has passed this sequence number
+          return sequence < oldest() or (0 != after and after > sequence) ? overrun : not_yet;
+        }
+    };
+};
+
+#endif //__CHANGE_LOG_HPP__
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "enum_solutions.hpp"
+
+#include <stdexcept>
+
+const size_t EnumSolutions::max_states;
+
+void EnumSolutions::add(const std::string& solution, const std::string& names) {
+  std::vector<std::string> states;
+  size_t start = 0;
+  while (start <= names.size()) {
+    size_t end = names.find(',', start);
+    if (std::string::npos == end) {
+      end = names.size();
+    }
+    if (end == start) {
+      throw std::invalid_argument("Empty state name for solution " + solution);
+    }
+    states.push_back(names.substr(start, end - start));
+    start = end + 1;
+  }
+  if (2 > states.size() or max_states < states.size()) {
+    throw std::invalid_argument("Solution " + solution + " must have between 2 and 16 states");
+  }
+  state_names[solution] = states;
+}
+
+int EnumSolutions::valueBits() const {
+  int bits = 0;
+  for (auto& solution : state_names) {
+    if (4 < solution.second.size()) {
+      return 4;
+    }
+    bits = 2;
+  }
+  return bits;
+}
+
+void EnumSolutions::resize(size_t slots) {
+  //Without enumerated solutions every sensor is binary
+  if (not empty() and slot_states.size() < slots) {
+    slot_states.resize(slots, 2);
+  }
+}
+
+void EnumSolutions::assign(size_t slot, const std::string& solution) {
+  if (slot >= slot_states.size()) {
+    return;
+  }
+  auto I = state_names.find(solution);
+  slot_states[slot] = state_names.end() == I ? 2 : I->second.size();
+}
+
+std::string EnumSolutions::stateName(const std::string& solution, uint8_t value) const {
+  auto I = state_names.find(solution);
+  if (state_names.end() == I or value >= I->second.size()) {
+    return std::to_string(int(value));
+  }
+  return I->second[value];
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file enum_solutions.hpp
+ * Solutions with a small number of named states, such as a coffee pot that
+ * is idle, brewing or ready, next to the binary ones.
+ *
+ * A sensor of an enumerated solution reports the number of its state in
+ * the first byte of its binary data and is published with that number.
+ * The state store keeps its value in a packed 2 bit field when every
+ * enumerated solution has at most 4 states and in a 4 bit field otherwise,
+ * so up to 16 states are supported.
+ ******************************************************************************/
+
+#ifndef __ENUM_SOLUTIONS_HPP__
+#define __ENUM_SOLUTIONS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+class EnumSolutions {
+  public:
+    static const size_t max_states = 16;
+
+  private:
+    std::map<std::string, std::vector<std::string>> state_names;
+    //Number of states of each slot, 2 for binary sensors
+    std::vector<uint8_t> slot_states;
+
+  public:
+    /**
+     * Add a solution with the states in a comma separated list, such as
+     * "idle,brewing,ready". Its first state is the one binary consumers
+     * see as false.
+     * Throws std::invalid_argument if there are fewer than 2 or more than
+     * max_states states.
+     */
+    void add(const std::string& solution, const std::string& names);
+
+    bool empty() const { return state_names.empty(); }
+
+    ///The state names of each enumerated solution.
+    const std::map<std::string, std::vector<std::string>>& solutions() const { return state_names; }
+
+    ///Bits needed to store the value of any sensor, 0 without enumerated solutions.
+    int valueBits() const;
+
+    ///Make room for at least the given number of sensor slots.
+    void resize(size_t slots);
+
+    ///Give a slot the states of its solution.
+    void assign(size_t slot, const std::string& solution);
+
+    ///Number of states of a slot's sensor.
+    uint8_t states(size_t slot) const { return slot < slot_states.size() ? slot_states[slot] : 2; }
+
+    ///The name of a state of a solution, or its number if the solution is not enumerated.
+    std::string stateName(const std::string& solution, uint8_t value) const;
+};
+
+#endif //__ENUM_SOLUTIONS_HPP__
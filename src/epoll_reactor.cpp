@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "epoll_reactor.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+EpollReactor::EpollReactor() : buffer(64 * 1024) {
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (-1 == epoll_fd) {
+    throw std::runtime_error(std::string("Could not create epoll instance: ") + strerror(errno));
+  }
+}
+
+EpollReactor::~EpollReactor() {
+  close(epoll_fd);
+}
+
+void EpollReactor::updateEvents(int fd, Watch& watch) {
+  uint32_t wanted = 0;
+  if (watch.on_readable or watch.on_data) {
+    wanted |= EPOLLIN;
+  }
+  if (not watch.outgoing.empty()) {
+    wanted |= EPOLLOUT;
+  }
+  if (wanted == watch.events) {
+    return;
+  }
+  epoll_event event;
+  memset(&event, 0, sizeof(event));
+  event.events = wanted;
+  event.data.fd = fd;
+  int op = (0 == watch.events) ? EPOLL_CTL_ADD : (0 == wanted ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+  ++num_syscalls;
+  if (-1 == epoll_ctl(epoll_fd, op, fd, &event)) {
+    throw std::runtime_error(std::string("Could not watch descriptor: ") + strerror(errno));
+  }
+  watch.events = wanted;
+}
+
+void EpollReactor::add(int fd, std::function<void()> on_readable) {
+  Watch& watch = watches[fd];
+  watch.on_readable = on_readable;
+  updateEvents(fd, watch);
+}
+
+void EpollReactor::addReceiver(int fd, DataHandler on_data) {
+  setNonBlocking(fd);
+  Watch& watch = watches[fd];
+  watch.on_data = on_data;
+  updateEvents(fd, watch);
+}
+
+void EpollReactor::remove(int fd) {
+  auto I = watches.find(fd);
+  if (watches.end() == I) {
+    return;
+  }
+  if (0 != I->second.events) {
+    ++num_syscalls;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+  }
+  watches.erase(I);
+}
+
+void EpollReactor::send(int fd, const char* data, size_t length) {
+  watches[fd].outgoing.append(data, length);
+}
+
+size_t EpollReactor::pendingBytes(int fd) const {
+  auto I = watches.find(fd);
+  return (watches.end() == I) ? 0 : I->second.outgoing.size();
+}
+
+void EpollReactor::flush(int fd, Watch& watch) {
+  while (not watch.outgoing.empty()) {
+    ++num_syscalls;
+    ssize_t sent = ::send(fd, watch.outgoing.data(), watch.outgoing.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (0 < sent) {
+      watch.outgoing.erase(0, sent);
+    }
+    else if (EINTR == errno) {
+      continue;
+    }
+    else if (EAGAIN == errno or EWOULDBLOCK == errno) {
+      break;
+    }
+    else {
+      //The connection failed, so the data can never be delivered. A receiver
+      //on this socket will see the failure and report it.
+      watch.outgoing.clear();
+    }
+  }
+  //Wait for the socket to become writable if it is full
+  updateEvents(fd, watch);
+}
+
+void EpollReactor::receive(int fd) {
+  while (true) {
+    ++num_syscalls;
+    ssize_t got = recv(fd, buffer.data(), buffer.size(), 0);
+    if (0 > got and EINTR == errno) {
+      continue;
+    }
+    if (0 > got and (EAGAIN == errno or EWOULDBLOCK == errno)) {
+      return;
+    }
+    auto I = watches.find(fd);
+    if (watches.end() == I) {
+      return;
+    }
+    //Copy the handler in case it removes this descriptor
+    DataHandler on_data = I->second.on_data;
+    if (0 < got) {
+      on_data(buffer.data(), got);
+    }
+    else {
+      remove(fd);
+      on_data(nullptr, 0);
+      return;
+    }
+  }
+}
+
+int EpollReactor::wait(int timeout_ms) {
+  for (auto& watch : watches) {
+    if (not watch.second.outgoing.empty() and not (watch.second.events & EPOLLOUT)) {
+      flush(watch.first, watch.second);
+    }
+  }
+
+  const int max_events = 64;
+  epoll_event events[max_events];
+  ++num_syscalls;
+  int ready = epoll_wait(epoll_fd, events, max_events, timeout_ms);
+  int called = 0;
+  for (int i = 0; i < ready; ++i) {
+    int fd = events[i].data.fd;
+    //A handler may have removed a descriptor from this batch
+    auto I = watches.find(fd);
+    if (watches.end() == I) {
+      continue;
+    }
+    if (events[i].events & EPOLLOUT) {
+      flush(fd, I->second);
+    }
+    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+      if (I->second.on_data) {
+        receive(fd);
+        ++called;
+      }
+      else if (I->second.on_readable) {
+        //Copy in case the handler removes itself
+        std::function<void()> handler = I->second.on_readable;
+        handler();
+        ++called;
+      }
+    }
+  }
+  return called;
+}
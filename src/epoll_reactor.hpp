@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file epoll_reactor.hpp
+ * Readiness based reactor backend built on epoll.
+ ******************************************************************************/
+
+#ifndef __EPOLL_REACTOR_HPP__
+#define __EPOLL_REACTOR_HPP__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "reactor.hpp"
+
+class EpollReactor : public Reactor {
+  private:
+    struct Watch {
+      std::function<void()> on_readable;
+      DataHandler on_data;
+      std::string outgoing;
+      //Events currently registered with epoll
+      uint32_t events;
+    };
+    int epoll_fd;
+    std::map<int, Watch> watches;
+    //Receive buffer shared by every socket
+    std::vector<char> buffer;
+
+    ///Register the events a watch needs with epoll, or drop it if none.
+    void updateEvents(int fd, Watch& watch);
+
+    ///Write as much queued data as the socket accepts.
+    void flush(int fd, Watch& watch);
+
+    ///Read until the socket would block, passing data to the handler.
+    void receive(int fd);
+
+    EpollReactor(const EpollReactor&) = delete;
+    EpollReactor& operator=(const EpollReactor&) = delete;
+
+  public:
+    ///Throws std::runtime_error if the epoll instance cannot be created.
+    EpollReactor();
+    ~EpollReactor();
+
+    void add(int fd, std::function<void()> on_readable);
+    void addReceiver(int fd, DataHandler on_data);
+    void remove(int fd);
+    void send(int fd, const char* data, size_t length);
+    size_t pendingBytes(int fd) const;
+    int wait(int timeout_ms);
+    const char* name() const { return "epoll"; }
+};
+
+#endif //__EPOLL_REACTOR_HPP__
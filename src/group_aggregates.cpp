@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "group_aggregates.hpp"
+
+const uint32_t GroupAggregates::no_group;
+
+GroupAggregates::GroupAggregates(char separator, size_t max_depth) :
+  separator(separator), max_depth(max_depth) {
+}
+
+void GroupAggregates::setGroup(const std::string& prefix, const std::string& group) {
+  explicit_groups[prefix] = group;
+}
+
+uint32_t GroupAggregates::groupFor(const std::string& uri, const std::string& solution) {
+  std::string key = uri;
+  key.push_back('\0');
+  key.append(solution);
+  auto I = group_index.find(key);
+  if (group_index.end() != I) {
+    return I->second;
+  }
+  //Create the ancestors first; the parent of a.b.c is a.b
+  uint32_t parent = no_group;
+  size_t split = uri.rfind(separator);
+  if (std::string::npos != split and 0 < split) {
+    parent = groupFor(uri.substr(0, split), solution);
+  }
+  uint32_t index = groups.size();
+  groups.push_back(Group{uri, solution, parent, 0, 0, false});
+  group_index[key] = index;
+  return index;
+}
+
+void GroupAggregates::add(uint32_t group, int delta_count, int delta_true) {
+  for (uint32_t index = group; no_group != index; index = groups[index].parent) {
+    Group& g = groups[index];
+    g.count += delta_count;
+    g.count_true += delta_true;
+    markDirty(index);
+  }
+}
+
+void GroupAggregates::markDirty(uint32_t group) {
+  if (not groups[group].dirty) {
+    groups[group].dirty = true;
+    dirty_groups.push_back(group);
+  }
+}
+
+void GroupAggregates::assign(size_t slot, const std::string& uri, const std::string& solution) {
+  forget(slot);
+  if (slot_group.size() <= slot) {
+    slot_group.resize(slot + 1, no_group);
+    slot_state.resize(slot + 1, none);
+  }
+  std::string group;
+  if (explicit_groups.empty()) {
+    //The object's own URI less its last level, cut to the maximum depth
+    size_t end = uri.rfind(separator);
+    if (std::string::npos == end or 0 == end) {
+      return;
+    }
+    size_t levels = 1;
+    for (size_t pos = uri.find(separator); pos < end; pos = uri.find(separator, pos + 1)) {
+      if (0 != max_depth and levels == max_depth) {
+        end = pos;
+        break;
+      }
+      ++levels;
+    }
+    group = uri.substr(0, end);
+  }
+  else {
+    //The group of the longest matching prefix
+    for (size_t length = uri.size(); 0 < length and group.empty(); --length) {
+      auto I = explicit_groups.find(uri.substr(0, length));
+      if (explicit_groups.end() != I) {
+        group = I->second;
+      }
+    }
+    if (group.empty()) {
+      return;
+    }
+  }
+  slot_group[slot] = groupFor(group, solution);
+}
+
+void GroupAggregates::forget(size_t slot) {
+  if (slot >= slot_group.size() or no_group == slot_group[slot]) {
+    return;
+  }
+  if (none != slot_state[slot]) {
+    add(slot_group[slot], -1, is_true == slot_state[slot] ? -1 : 0);
+  }
+  slot_group[slot] = no_group;
+  slot_state[slot] = none;
+}
+
+void GroupAggregates::update(size_t slot, bool value) {
+  if (slot >= slot_group.size() or no_group == slot_group[slot]) {
+    return;
+  }
+  uint8_t state = value ? is_true : is_false;
+  uint8_t old = slot_state[slot];
+  if (old == state) {
+    return;
+  }
+  slot_state[slot] = state;
+  add(slot_group[slot], none == old ? 1 : 0, (value ? 1 : 0) - (is_true == old ? 1 : 0));
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file group_aggregates.hpp
+ * Counts of sensor states per group of objects, such as the number of open
+ * doors on a floor or whether any water sensor in a building is wet.
+ *
+ * Groups form a tree. By default the groups of an object are the prefixes
+ * of its URI: winlab.floor3.room12 is in winlab.floor3 and in winlab.
+ * Explicit groups map URI prefixes to group URIs instead, and the group
+ * URIs nest by their own prefixes. There is one count per group and
+ * solution. A state change walks from the sensor's group to the root, so it
+ * costs one update per level, and the changed groups are published as
+ * solutions of the group URI.
+ ******************************************************************************/
+
+#ifndef __GROUP_AGGREGATES_HPP__
+#define __GROUP_AGGREGATES_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class GroupAggregates {
+  public:
+    ///The counts of one solution in one group.
+    struct Group {
+      std::string uri;
+      std::string solution;
+      ///Index of the parent group, or no_group at the root.
+      uint32_t parent;
+      ///Sensors with a known state and how many of them are true.
+      uint32_t count;
+      uint32_t count_true;
+      bool dirty;
+    };
+
+    static const uint32_t no_group = UINT32_MAX;
+
+  private:
+    //What a slot currently adds to its groups
+    enum Contribution : uint8_t {none, is_false, is_true};
+
+    char separator;
+    size_t max_depth;
+    //Explicit groups by URI prefix; empty to group by URI prefixes
+    std::map<std::string, std::string> explicit_groups;
+
+    std::vector<Group> groups;
+    std::unordered_map<std::string, uint32_t> group_index;
+    std::vector<uint32_t> dirty_groups;
+    //The innermost group and the contribution of each sensor slot
+    std::vector<uint32_t> slot_group;
+    std::vector<uint8_t> slot_state;
+
+    ///Find or create the group and its ancestors.
+    uint32_t groupFor(const std::string& uri, const std::string& solution);
+    ///Add delta_count and delta_true to a group and all of its ancestors.
+    void add(uint32_t group, int delta_count, int delta_true);
+
+  public:
+    /**
+     * @param separator The character between URI levels.
+     * @param max_depth The number of levels to group by, 0 for all of them.
+     */
+    GroupAggregates(char separator, size_t max_depth);
+
+    /**
+     * Put objects whose URI starts with prefix into the group with the given
+     * URI. Once any explicit group is set objects are only grouped this way,
+     * by their longest matching prefix.
+     */
+    void setGroup(const std::string& prefix, const std::string& group);
+
+    /**
+     * Set the object and solution of a sensor slot, taking its old state
+     * out of its old groups.
+     */
+    void assign(size_t slot, const std::string& uri, const std::string& solution);
+
+    ///Take a sensor out of its groups.
+    void forget(size_t slot);
+
+    ///Set the state of a sensor, updating each of its groups.
+    void update(size_t slot, bool value);
+
+    ///Number of groups that changed since they were last drained.
+    size_t dirtyCount() const { return dirty_groups.size(); }
+
+    ///Number of groups.
+    size_t size() const { return groups.size(); }
+
+    ///Mark a group as needing to be published again.
+    void markDirty(uint32_t group);
+
+    ///Call f(index, group) for every group that changed and clear their dirty flags.
+    template<typename F>
+    void drainDirty(F f) {
+      std::vector<uint32_t> drained;
+      drained.swap(dirty_groups);
+      for (uint32_t index : drained) {
+        groups[index].dirty = false;
+        f(index, groups[index]);
+      }
+    }
+};
+
+#endif //__GROUP_AGGREGATES_HPP__
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "huge_pages.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+  enum class Backing {hugetlb, transparent, normal};
+
+  std::atomic<bool> low_latency(false);
+
+  //Directly mapped regions and what backs them, for deallocation and reporting
+  std::mutex regions_mutex;
+  std::map<void*, Backing> regions;
+  size_t backed_bytes[3] = {0, 0, 0};
+
+  void remember(void* ptr, size_t bytes, Backing backing) {
+    std::unique_lock<std::mutex> lck(regions_mutex);
+    regions[ptr] = backing;
+    backed_bytes[(int)backing] += bytes;
+  }
+
+  //Touch every normal page of a region so it is faulted in now rather
+  //than on first use in the hot path.
+  void prefault(void* ptr, size_t bytes) {
+    volatile char* mem = static_cast<volatile char*>(ptr);
+    size_t step = sysconf(_SC_PAGESIZE);
+    for (size_t offset = 0; offset < bytes; offset += step) {
+      mem[offset] = 0;
+    }
+  }
+}
+
+bool huge_pages::enableLowLatency() {
+  low_latency = true;
+  return 0 == mlockall(MCL_CURRENT | MCL_FUTURE);
+}
+
+bool huge_pages::lowLatency() {
+  return low_latency;
+}
+
+void* huge_pages::allocate(size_t bytes) {
+  if (bytes < direct_threshold) {
+    return ::operator new(bytes);
+  }
+  size_t rounded = (bytes + page_size - 1) / page_size * page_size;
+  if (low_latency) {
+#ifdef MAP_HUGETLB
+    //Reserved huge pages from hugetlbfs, populated by the kernel
+    void* ptr = mmap(nullptr, rounded, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    if (MAP_FAILED != ptr) {
+      remember(ptr, rounded, Backing::hugetlb);
+      return ptr;
+    }
+#endif
+  }
+  void* ptr = mmap(nullptr, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == ptr) {
+    throw std::bad_alloc();
+  }
+  if (low_latency) {
+    //Fall back to transparent huge pages. Advise before the pages are
+    //touched so that the faults can be served with huge pages.
+#ifdef MADV_HUGEPAGE
+    madvise(ptr, rounded, MADV_HUGEPAGE);
+#endif
+    prefault(ptr, rounded);
+    remember(ptr, rounded, Backing::transparent);
+  }
+  else {
+    remember(ptr, rounded, Backing::normal);
+  }
+  return ptr;
+}
+
+void huge_pages::deallocate(void* ptr, size_t bytes) {
+  if (bytes < direct_threshold) {
+    ::operator delete(ptr);
+    return;
+  }
+  size_t rounded = (bytes + page_size - 1) / page_size * page_size;
+  {
+    std::unique_lock<std::mutex> lck(regions_mutex);
+    auto I = regions.find(ptr);
+    if (regions.end() != I) {
+      backed_bytes[(int)I->second] -= rounded;
+      regions.erase(I);
+    }
+  }
+  munmap(ptr, rounded);
+}
+
+std::string huge_pages::report() {
+  size_t hugetlb, transparent, normal;
+  {
+    std::unique_lock<std::mutex> lck(regions_mutex);
+    hugetlb = backed_bytes[(int)Backing::hugetlb];
+    transparent = backed_bytes[(int)Backing::transparent];
+    normal = backed_bytes[(int)Backing::normal];
+  }
+  //Advising is only a hint, so ask the kernel how much it really backed
+  //with transparent huge pages.
+  size_t anon_huge_kb = 0;
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string line;
+  while (std::getline(smaps, line)) {
+    if (0 == line.compare(0, 14, "AnonHugePages:")) {
+      std::istringstream(line.substr(14)) >> anon_huge_kb;
+    }
+  }
+  std::ostringstream out;
+  out<<"low latency profile "<<(low_latency ? "on" : "off")<<"; ";
+  out<<hugetlb / 1024<<" kB on hugetlbfs pages, ";
+  out<<transparent / 1024<<" kB advised for transparent huge pages (";
+  out<<anon_huge_kb<<" kB of the process backed by them), ";
+  out<<normal / 1024<<" kB on normal pages";
+  return out.str();
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file huge_pages.hpp
+ * Memory for the solver's large tables. Big allocations are mapped directly
+ * and, in the low latency profile, taken from 2MB huge pages (hugetlbfs
+ * first, then transparent huge pages through madvise) and prefaulted so
+ * that the hot path sees neither page faults nor many TLB misses.
+ ******************************************************************************/
+
+#ifndef __HUGE_PAGES_HPP__
+#define __HUGE_PAGES_HPP__
+
+#include <cstddef>
+#include <new>
+#include <string>
+
+namespace huge_pages {
+  ///Size of one huge page.
+  const size_t page_size = 2 * 1024 * 1024;
+
+  ///Allocations at least this big are mapped directly instead of using new.
+  const size_t direct_threshold = page_size;
+
+  /**
+   * Turn on the low latency profile: try to back large allocations with
+   * huge pages, prefault them, and lock all current and future memory of
+   * the process with mlockall.
+   * @return false if the memory could not be locked (the rest of the
+   *         profile still applies).
+   */
+  bool enableLowLatency();
+
+  ///True once enableLowLatency has been called.
+  bool lowLatency();
+
+  /**
+   * Allocate bytes of memory. Allocations of at least direct_threshold
+   * bytes are rounded up to whole huge pages and mapped directly.
+   */
+  void* allocate(size_t bytes);
+
+  ///Release memory from allocate. bytes must match the allocation.
+  void deallocate(void* ptr, size_t bytes);
+
+  /**
+   * Describe how much directly mapped memory is on hugetlbfs pages, how
+   * much the kernel actually backed with transparent huge pages, and how
+   * much ended up on normal pages.
+   */
+  std::string report();
+
+  ///Standard allocator that places large containers with huge_pages::allocate.
+  template<typename T>
+  struct Allocator {
+    typedef T value_type;
+
+    Allocator() {}
+    template<typename U>
+    Allocator(const Allocator<U>&) {}
+
+    T* allocate(size_t n) {
+      return static_cast<T*>(huge_pages::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+      huge_pages::deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    struct rebind {
+      typedef Allocator<U> other;
+    };
+  };
+
+  template<typename T, typename U>
+  bool operator==(const Allocator<T>&, const Allocator<U>&) { return true; }
+  template<typename T, typename U>
+  bool operator!=(const Allocator<T>&, const Allocator<U>&) { return false; }
+}
+
+#endif //__HUGE_PAGES_HPP__
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "load_shedder.hpp"
+
+#include <algorithm>
+#include <climits>
+
+LoadShedder::LoadShedder(const Config& config) :
+  config(config), current(normal), behind_since(-1), last_behind(0), num_events(0) {
+}
+
+bool LoadShedder::observe(int64_t now_ms, size_t waiting, bool held_back) {
+  if (not enabled()) {
+    return false;
+  }
+  if (held_back) {
+    if (0 > behind_since) {
+      behind_since = now_ms;
+    }
+    last_behind = now_ms;
+  }
+  else {
+    behind_since = -1;
+  }
+  int64_t age = 0 > behind_since ? 0 : now_ms - behind_since;
+  //How far over its limit each measure is, in multiples of the limit
+  auto over = [](double value, double limit) { return 0 < limit ? value / limit : 0; };
+  double load = std::max(over(waiting, config.max_waiting), over(age, config.max_age_ms));
+  Level level = current;
+  if (2 <= load) {
+    level = severe;
+  }
+  else if (1 <= load and normal == current) {
+    level = overloaded;
+  }
+  else if (normal != current and not held_back and now_ms - last_behind >= config.recover_ms and 1 > load) {
+    level = normal;
+  }
+  if (level == current) {
+    return false;
+  }
+  current = level;
+  ++num_events;
+  return true;
+}
+
+int LoadShedder::shedBelow() const {
+  switch (current) {
+    case overloaded:
+      return 0;
+    case severe:
+      return 1;
+    default:
+      return INT_MIN;
+  }
+}
+
+const char* LoadShedder::name(Level level) {
+  switch (level) {
+    case overloaded:
+      return "overloaded";
+    case severe:
+      return "severe";
+    default:
+      return "normal";
+  }
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file load_shedder.hpp
+ * Detect sustained overload of the publish path and choose how far to
+ * degrade, so that the latency of the most important solutions stays
+ * bounded however many changes arrive.
+ *
+ * The shedder watches each publish pass: how many transitions were waiting
+ * and how long the priority lanes have been holding some back without
+ * catching up. The solver is overloaded once either passes its limit, and
+ * severely overloaded at twice the limit. It only recovers after the lanes
+ * have kept up for the recovery time, so it does not flap at the edge.
+ *
+ * While overloaded the solver suspends its group counts, time in state and
+ * longest open lists and the per transition log lines, and sheds the lanes
+ * below priority 0; when severely overloaded only lanes above priority 0
+ * are sent. Rule results and alerts are treated as critical and are still
+ * published at every level. Every change of level is counted as a
+ * shedding event.
+ ******************************************************************************/
+
+#ifndef __LOAD_SHEDDER_HPP__
+#define __LOAD_SHEDDER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+class LoadShedder {
+  public:
+    enum Level {normal, overloaded, severe};
+
+    struct Config {
+      ///Transitions waiting at the start of a pass that mean overload, 0 for no limit.
+      size_t max_waiting;
+      ///Time the lanes may hold changes back before it is overload, 0 for no limit.
+      int64_t max_age_ms;
+      ///Time the lanes must keep up before the load counts as normal again.
+      int64_t recover_ms;
+    };
+
+  private:
+    Config config;
+    Level current;
+    //When the lanes started holding changes back, or -1 if they are not
+    int64_t behind_since;
+    //When the lanes last held changes back
+    int64_t last_behind;
+    uint64_t num_events;
+
+  public:
+    LoadShedder(const Config& config);
+
+    ///True if either limit is set.
+    bool enabled() const { return 0 < config.max_waiting or 0 < config.max_age_ms; }
+
+    /**
+     * Observe one publish pass.
+     * @param now_ms The current time.
+     * @param waiting The number of transitions waiting when the pass began.
+     * @param held_back True if the pass left transitions for a later one.
+     * @return true if the level changed.
+     */
+    bool observe(int64_t now_ms, size_t waiting, bool held_back);
+
+    Level level() const { return current; }
+
+    ///Lanes below this priority are shed at the current level.
+    int shedBelow() const;
+
+    ///Number of level changes so far.
+    uint64_t events() const { return num_events; }
+
+    static const char* name(Level level);
+};
+
+#endif //__LOAD_SHEDDER_HPP__
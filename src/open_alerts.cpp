@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "open_alerts.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+const uint8_t OpenAlerts::no_class;
+const uint32_t OpenAlerts::no_slot;
+
+OpenAlerts::OpenAlerts(int64_t tick_ms, size_t wheel_size) :
+  tick_ms(tick_ms), buckets(wheel_size, no_slot), current_tick(0) {
+  if (0 == wheel_size or 0 != (wheel_size & (wheel_size - 1))) {
+    throw std::invalid_argument("The timer wheel size must be a power of two");
+  }
+}
+
+void OpenAlerts::addClass(const std::string& solution, bool alert_value, int64_t threshold_ms) {
+  if (no_class == classes.size()) {
+    throw std::invalid_argument("Too many alert classes");
+  }
+  classes.push_back(Class{solution, alert_value, threshold_ms, {}});
+}
+
+void OpenAlerts::resize(size_t slots) {
+  if (timers.size() < slots) {
+    timers.resize(slots, Timer{0, 0, no_slot, no_slot, no_slot, no_slot, no_class, false, false, false});
+  }
+}
+
+void OpenAlerts::schedule(uint32_t slot) {
+  Timer& timer = timers[slot];
+  //Round up so that the deadline has passed when its tick is advanced over,
+  //and fire a deadline that already passed on the next tick
+  int64_t tick = std::max((timer.deadline + tick_ms - 1) / tick_ms, current_tick + 1);
+  timer.bucket = tick & (buckets.size() - 1);
+  uint32_t& head = buckets[timer.bucket];
+  timer.prev = no_slot;
+  timer.next = head;
+  if (no_slot != head) {
+    timers[head].prev = slot;
+  }
+  head = slot;
+}
+
+void OpenAlerts::cancel(uint32_t slot) {
+  Timer& timer = timers[slot];
+  if (no_slot == timer.bucket) {
+    return;
+  }
+  if (no_slot != timer.prev) {
+    timers[timer.prev].next = timer.next;
+  }
+  else {
+    buckets[timer.bucket] = timer.next;
+  }
+  if (no_slot != timer.next) {
+    timers[timer.next].prev = timer.prev;
+  }
+  timer.bucket = no_slot;
+  timer.prev = no_slot;
+  timer.next = no_slot;
+}
+
+bool OpenAlerts::earlier(uint32_t a, uint32_t b) const {
+  return timers[a].since < timers[b].since or (timers[a].since == timers[b].since and a < b);
+}
+
+void OpenAlerts::heapPlace(Class& cls, size_t pos, uint32_t slot) {
+  cls.heap[pos] = slot;
+  timers[slot].heap_pos = pos;
+}
+
+void OpenAlerts::heapUp(Class& cls, size_t pos) {
+  uint32_t slot = cls.heap[pos];
+  while (0 < pos and earlier(slot, cls.heap[(pos - 1) / 2])) {
+    heapPlace(cls, pos, cls.heap[(pos - 1) / 2]);
+    pos = (pos - 1) / 2;
+  }
+  heapPlace(cls, pos, slot);
+}
+
+void OpenAlerts::heapDown(Class& cls, size_t pos) {
+  uint32_t slot = cls.heap[pos];
+  while (true) {
+    size_t child = 2 * pos + 1;
+    if (child >= cls.heap.size()) {
+      break;
+    }
+    if (child + 1 < cls.heap.size() and earlier(cls.heap[child + 1], cls.heap[child])) {
+      ++child;
+    }
+    if (not earlier(cls.heap[child], slot)) {
+      break;
+    }
+    heapPlace(cls, pos, cls.heap[child]);
+    pos = child;
+  }
+  heapPlace(cls, pos, slot);
+}
+
+void OpenAlerts::heapPush(Class& cls, uint32_t slot) {
+  cls.heap.push_back(slot);
+  heapUp(cls, cls.heap.size() - 1);
+}
+
+void OpenAlerts::heapRemove(Class& cls, uint32_t slot) {
+  size_t pos = timers[slot].heap_pos;
+  uint32_t last = cls.heap.back();
+  cls.heap.pop_back();
+  timers[slot].heap_pos = no_slot;
+  if (pos < cls.heap.size()) {
+    heapPlace(cls, pos, last);
+    heapUp(cls, pos);
+    heapDown(cls, timers[last].heap_pos);
+  }
+}
+
+void OpenAlerts::markDirty(size_t slot) {
+  if (not timers[slot].queued) {
+    timers[slot].queued = true;
+    changed.push_back(slot);
+  }
+}
+
+void OpenAlerts::close(uint32_t slot) {
+  Timer& timer = timers[slot];
+  if (not timer.open) {
+    return;
+  }
+  cancel(slot);
+  heapRemove(classes[timer.cls], slot);
+  timer.open = false;
+  if (timer.raised) {
+    timer.raised = false;
+    markDirty(slot);
+  }
+}
+
+void OpenAlerts::assign(size_t slot, const std::string& solution) {
+  forget(slot);
+  for (size_t cls = 0; cls < classes.size(); ++cls) {
+    if (classes[cls].solution == solution) {
+      timers[slot].cls = cls;
+      return;
+    }
+  }
+}
+
+void OpenAlerts::forget(size_t slot) {
+  if (slot >= timers.size() or no_class == timers[slot].cls) {
+    return;
+  }
+  //A queued slot stays in the changed list and is skipped when drained
+  close(slot);
+  timers[slot].cls = no_class;
+}
+
+void OpenAlerts::transition(size_t slot, bool value, int64_t time) {
+  if (slot >= timers.size() or no_class == timers[slot].cls) {
+    return;
+  }
+  Timer& timer = timers[slot];
+  Class& cls = classes[timer.cls];
+  if (value != cls.alert_value) {
+    close(slot);
+  }
+  else if (not timer.open) {
+    timer.open = true;
+    timer.since = time;
+    timer.deadline = time + cls.threshold_ms;
+    schedule(slot);
+    heapPush(cls, slot);
+  }
+}
+
+size_t OpenAlerts::advance(int64_t now) {
+  int64_t now_tick = now / tick_ms;
+  //Going around the wheel once visits every bucket
+  int64_t tick = std::max(current_tick + 1, now_tick - int64_t(buckets.size()) + 1);
+  size_t raised = 0;
+  for (; tick <= now_tick; ++tick) {
+    uint32_t slot = buckets[tick & (buckets.size() - 1)];
+    while (no_slot != slot) {
+      Timer& timer = timers[slot];
+      uint32_t next = timer.next;
+      //Deadlines further out wait for a later turn of the wheel
+      if (timer.deadline <= tick * tick_ms) {
+        cancel(slot);
+        timer.raised = true;
+        markDirty(slot);
+        ++raised;
+      }
+      slot = next;
+    }
+  }
+  current_tick = std::max(current_tick, now_tick);
+  return raised;
+}
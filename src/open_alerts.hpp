@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file open_alerts.hpp
+ * Alerts for sensors that stay in an alerting state too long, such as a
+ * door that is left open, and the sensors of each class that have been in
+ * that state the longest.
+ *
+ * Every solution with a threshold is a class. Entering the alerting state
+ * schedules the sensor's deadline in a hashed timer wheel and leaving it
+ * cancels the deadline, both in constant time. Advancing the wheel only
+ * visits the buckets of the ticks that passed. The sensors currently in the
+ * alerting state are also kept in one indexed min-heap per class ordered by
+ * the time they entered it, so the K longest are found in O(K log K) from
+ * the top of the heap instead of by scanning every sensor.
+ ******************************************************************************/
+
+#ifndef __OPEN_ALERTS_HPP__
+#define __OPEN_ALERTS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "huge_pages.hpp"
+
+class OpenAlerts {
+  public:
+    ///Sensors of one solution and when they alert.
+    struct Class {
+      std::string solution;
+      ///The state that alerts when it lasts longer than threshold_ms.
+      bool alert_value;
+      int64_t threshold_ms;
+      //Slots in the alerting state, a min-heap by the time they entered it
+      std::vector<uint32_t> heap;
+    };
+
+    static const uint8_t no_class = UINT8_MAX;
+
+  private:
+    static const uint32_t no_slot = UINT32_MAX;
+
+    struct Timer {
+      int64_t since;
+      int64_t deadline;
+      //The wheel bucket and neighbours in it while the deadline is scheduled
+      uint32_t bucket;
+      uint32_t prev;
+      uint32_t next;
+      uint32_t heap_pos;
+      uint8_t cls;
+      bool open;
+      bool raised;
+      //True while the slot is waiting in the changed list
+      bool queued;
+    };
+
+    int64_t tick_ms;
+    std::vector<Class> classes;
+    std::vector<Timer, huge_pages::Allocator<Timer>> timers;
+    std::vector<uint32_t> buckets;
+    //The last tick that was advanced over
+    int64_t current_tick;
+    std::vector<size_t> changed;
+
+    void schedule(uint32_t slot);
+    void cancel(uint32_t slot);
+    bool earlier(uint32_t a, uint32_t b) const;
+    void heapPlace(Class& cls, size_t pos, uint32_t slot);
+    void heapUp(Class& cls, size_t pos);
+    void heapDown(Class& cls, size_t pos);
+    void heapPush(Class& cls, uint32_t slot);
+    void heapRemove(Class& cls, uint32_t slot);
+    ///Leave the alerting state, clearing a raised alert.
+    void close(uint32_t slot);
+
+  public:
+    /**
+     * @param tick_ms The resolution of the deadlines.
+     * @param wheel_size Number of buckets, a power of two. Deadlines further
+     *                   out than the wheel covers wait for later turns.
+     */
+    OpenAlerts(int64_t tick_ms = 100, size_t wheel_size = 4096);
+
+    ///Alert when a sensor of the solution stays at alert_value longer than threshold_ms.
+    void addClass(const std::string& solution, bool alert_value, int64_t threshold_ms);
+
+    const std::vector<Class>& classList() const { return classes; }
+
+    ///Make room for at least the given number of sensor slots.
+    void resize(size_t slots);
+
+    ///Put a slot in the class of its solution, if there is one.
+    void assign(size_t slot, const std::string& solution);
+
+    ///Forget a sensor without publishing a cleared alert.
+    void forget(size_t slot);
+
+    ///Record that a sensor entered a state at the given time.
+    void transition(size_t slot, bool value, int64_t time);
+
+    /**
+     * Raise the alerts of every deadline up to now.
+     * @return The number of alerts raised.
+     */
+    size_t advance(int64_t now);
+
+    ///Number of sensors whose alert was raised or cleared and not drained yet.
+    size_t pending() const { return changed.size(); }
+
+    ///Queue a slot's alert to be published again.
+    void markDirty(size_t slot);
+
+    ///Call f(slot, raised) for every slot whose alert was raised or cleared.
+    template<typename F>
+    void drain(F f) {
+      std::vector<size_t> drained;
+      drained.swap(changed);
+      for (size_t slot : drained) {
+        Timer& timer = timers[slot];
+        timer.queued = false;
+        if (no_class != timer.cls) {
+          f(slot, timer.raised);
+        }
+      }
+    }
+
+    /**
+     * Call f(slot, since) for up to k sensors of a class that have been in
+     * the alerting state the longest, longest first.
+     */
+    template<typename F>
+    void longest(size_t cls, size_t k, F f) const {
+      const std::vector<uint32_t>& heap = classes[cls].heap;
+      //Candidate heap positions; the next longest is always the earliest
+      //candidate, and its children become candidates once it is taken
+      auto later = [&](size_t a, size_t b) { return earlier(heap[b], heap[a]); };
+      std::priority_queue<size_t, std::vector<size_t>, decltype(later)> candidates(later);
+      if (not heap.empty()) {
+        candidates.push(0);
+      }
+      for (size_t found = 0; found < k and not candidates.empty(); ++found) {
+        size_t pos = candidates.top();
+        candidates.pop();
+        f(size_t(heap[pos]), timers[heap[pos]].since);
+        for (size_t child = 2 * pos + 1; child <= 2 * pos + 2 and child < heap.size(); ++child) {
+          candidates.push(child);
+        }
+      }
+    }
+};
+
+#endif //__OPEN_ALERTS_HPP__
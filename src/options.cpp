@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "options.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+Options::Options(int arg_count, char** arg_vector) {
+  for (int i = 1; i < arg_count; ++i) {
+    std::string arg(arg_vector[i]);
+    if (0 == arg.compare(0, 2, "--")) {
+      size_t equals = arg.find('=');
+      if (std::string::npos == equals) {
+        named[arg.substr(2)] = "";
+      }
+      else {
+        named[arg.substr(2, equals - 2)] = arg.substr(equals + 1);
+      }
+    }
+    else {
+      positional.push_back(arg);
+    }
+  }
+  if (has("config")) {
+    loadFile(get("config", ""));
+  }
+}
+
+void Options::loadFile(const std::string& path) {
+  std::ifstream in(path);
+  if (not in) {
+    throw std::runtime_error("Could not read configuration file " + path);
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t start = line.find_first_not_of(" \t");
+    if (std::string::npos == start or '#' == line[start]) {
+      continue;
+    }
+    line = line.substr(start);
+    size_t split = line.find_first_of(" \t=");
+    std::string name = line.substr(0, split);
+    std::string value;
+    if (std::string::npos != split) {
+      size_t value_start = line.find_first_not_of(" \t=", split);
+      if (std::string::npos != value_start) {
+        size_t value_end = line.find_last_not_of(" \t\r");
+        value = line.substr(value_start, value_end - value_start + 1);
+      }
+    }
+    //Command line options take precedence
+    named.insert(std::make_pair(name, value));
+  }
+}
+
+bool Options::has(const std::string& name) const {
+  return named.end() != named.find(name);
+}
+
+std::string Options::get(const std::string& name, const std::string& def) const {
+  auto I = named.find(name);
+  if (named.end() == I) {
+    return def;
+  }
+  return I->second;
+}
+
+long Options::getInt(const std::string& name, long def) const {
+  auto I = named.find(name);
+  if (named.end() == I) {
+    return def;
+  }
+  //Trailing characters, as in 1k, are a typo rather than a number
+  size_t end = 0;
+  long value = 0;
+  try {
+    value = std::stol(I->second, &end);
+  }
+  catch (std::exception& err) {
+    end = 0;
+  }
+  if (0 == end or I->second.size() != end) {
+    throw std::invalid_argument("Option --" + name + " needs an integer value, not '" + I->second + "'");
+  }
+  return value;
+}
+
+std::map<std::string, std::string> Options::withPrefix(const std::string& prefix) const {
+  std::map<std::string, std::string> matches;
+  for (auto I = named.lower_bound(prefix); I != named.end() and 0 == I->first.compare(0, prefix.size(), prefix); ++I) {
+    matches[I->first.substr(prefix.size())] = I->second;
+  }
+  return matches;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file options.hpp
+ * Command line options of the solver. Arguments of the form --name or
+ * --name=value are named options, everything else is a positional argument.
+ * Named options may also be read from a configuration file given with
+ * --config=<file>, one "name value" or "name=value" pair per line. Options
+ * given on the command line take precedence over the file.
+ ******************************************************************************/
+
+#ifndef __OPTIONS_HPP__
+#define __OPTIONS_HPP__
+
+#include <map>
+#include <string>
+#include <vector>
+
+class Options {
+  private:
+    std::vector<std::string> positional;
+    std::map<std::string, std::string> named;
+
+  public:
+    /**
+     * Parse the command line and the configuration file named by --config.
+     * Throws std::runtime_error if the configuration file cannot be read.
+     */
+    Options(int arg_count, char** arg_vector);
+
+    /**
+     * Read named options from a configuration file. Blank lines and lines
+     * starting with # are ignored. Options that are already set are kept.
+     * Throws std::runtime_error if the file cannot be read.
+     */
+    void loadFile(const std::string& path);
+
+    ///Positional arguments, not including the program name.
+    const std::vector<std::string>& arguments() const { return positional; }
+
+    ///True if the named option was given.
+    bool has(const std::string& name) const;
+
+    ///The value of a named option, or def if it was not given.
+    std::string get(const std::string& name, const std::string& def) const;
+
+    /**
+     * The integer value of a named option, or def if it was not given.
+     * Throws std::invalid_argument if the value is not a whole number.
+     */
+    long getInt(const std::string& name, long def) const;
+
+    ///All named options whose names start with prefix, with the prefix removed.
+    std::map<std::string, std::string> withPrefix(const std::string& prefix) const;
+};
+
+#endif //__OPTIONS_HPP__
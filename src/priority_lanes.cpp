@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "priority_lanes.hpp"
+
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+PriorityLanes::PriorityLanes(const std::map<std::string, int>& priorities, size_t batch_limit) :
+  batch_limit(batch_limit), held_back(false), waiting(0), limited(0), shed_below(INT_MIN) {
+  std::set<int> levels{0};
+  for (auto& I : priorities) {
+    levels.insert(I.second);
+  }
+  if (levels.size() > UINT8_MAX) {
+    throw std::invalid_argument("Too many priority levels");
+  }
+  //Highest priority first
+  std::map<int, uint8_t> lane_of;
+  for (auto I = levels.rbegin(); I != levels.rend(); ++I) {
+    lane_of[*I] = lanes.size();
+    lanes.push_back(Lane{*I, 0, 0, 0, std::vector<size_t>(), 0});
+  }
+  for (auto& I : priorities) {
+    solution_lanes[I.first] = lane_of[I.second];
+  }
+  default_lane = lane_of[0];
+}
+
+void PriorityLanes::resize(size_t slots) {
+  if (slot_lanes.size() < slots) {
+    slot_lanes.resize(slots, default_lane);
+    is_shed.resize(slots, false);
+  }
+}
+
+void PriorityLanes::assign(size_t slot, const std::string& solution) {
+  resize(slot + 1);
+  auto I = solution_lanes.find(solution);
+  slot_lanes[slot] = solution_lanes.end() == I ? default_lane : I->second;
+}
+
+size_t PriorityLanes::collect(StateStore& states, size_t budget, const Hold& hold) {
+  size_t count = 0;
+  held_back = false;
+  states.drainDirty([&](size_t slot, bool) {
+      Lane& lane = lanes[slot < slot_lanes.size() ? slot_lanes[slot] : default_lane];
+      if (lane.priority >= shed_below) {
+        lane.queued.push_back(slot);
+        ++count;
+      }
+      else {
+        ++lane.shed;
+        if (slot < is_shed.size() and not is_shed[slot]) {
+          is_shed[slot] = true;
+          shed_slots.push_back(slot);
+        }
+      }
+    });
+  if (hold) {
+    count = 0;
+    for (Lane& lane : lanes) {
+      if (not lane.queued.empty()) {
+        hold(lane.queued);
+      }
+      count += lane.queued.size();
+    }
+  }
+  waiting = count;
+  limited = 0;
+  for (Lane& lane : lanes) {
+    size_t keep = lane.queued.size();
+    //Lanes above priority 0 are sent in full and borrow what the budget
+    //lacks; the lower lanes get what is left
+    if (0 >= lane.priority) {
+      if (0 < batch_limit) {
+        keep = std::min(keep, batch_limit);
+      }
+      if (keep > budget) {
+        limited += keep - budget;
+        keep = budget;
+      }
+    }
+    budget -= std::min(keep, budget);
+    if (keep < lane.queued.size()) {
+      count -= lane.queued.size() - keep;
+      holdBack(lane, keep, states);
+    }
+  }
+  return count;
+}
+
+void PriorityLanes::holdBack(Lane& lane, size_t keep, StateStore& states) {
+  std::vector<size_t>& queued = lane.queued;
+  //Take keep slots starting at the cursor, wrapping around, and leave the
+  //others for the next pass
+  size_t start = std::lower_bound(queued.begin(), queued.end(), lane.cursor) - queued.begin();
+  std::rotate(queued.begin(), queued.begin() + start, queued.end());
+  for (size_t i = keep; i < queued.size(); ++i) {
+    states.markDirty(queued[i]);
+  }
+  held_back = true;
+  lane.deferred += queued.size() - keep;
+  queued.resize(keep);
+  if (not queued.empty()) {
+    lane.cursor = queued.back() + 1;
+  }
+}
+
+void PriorityLanes::requeue(size_t lane, StateStore& states) {
+  for (; lane < lanes.size(); ++lane) {
+    for (size_t slot : lanes[lane].queued) {
+      states.markDirty(slot);
+    }
+    lanes[lane].queued.clear();
+  }
+}
+
+void PriorityLanes::shedBelow(int priority, StateStore& states) {
+  shed_below = priority;
+  size_t kept = 0;
+  for (size_t slot : shed_slots) {
+    const Lane& lane = lanes[slot_lanes[slot]];
+    if (lane.priority < shed_below) {
+      shed_slots[kept++] = slot;
+      continue;
+    }
+    is_shed[slot] = false;
+    //A sensor that was removed meanwhile has nothing left to send
+    if (states.isKnown(slot)) {
+      states.markDirty(slot);
+    }
+  }
+  shed_slots.resize(kept);
+}
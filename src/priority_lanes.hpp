@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file priority_lanes.hpp
+ * Outbound lanes that order the publishing of sensor transitions by the
+ * priority of their solution, so that a water leak is not sent behind
+ * thousands of door changes.
+ *
+ * Each solution is given a priority (0 by default) and every priority is a
+ * lane. When the changed sensors are collected for publishing they are
+ * split into their lanes, and the lanes are sent highest priority first.
+ * Lanes with a priority above 0 are always sent in full. The other lanes
+ * send at most batch_limit transitions at a time; the rest stay dirty in
+ * the state store, where later changes of the same sensor coalesce, and are
+ * sent on the next pass after newer input had a chance to reach the higher
+ * lanes. A cursor per lane makes each pass continue where the previous one
+ * stopped so that no sensor is starved.
+ *
+ * A pass may also be given a budget, such as the tokens left under a rate
+ * limit. The budget is spent on the highest lanes first. Lanes with a
+ * priority above 0 are still sent in full, borrowing what the budget lacks,
+ * so that a water leak never waits for tokens. In the other lanes what does
+ * not fit stays dirty in the same way, so the latest state of each sensor
+ * wins.
+ *
+ * Under overload the lanes below a priority can be shed: their changes are
+ * not sent at all, and each shed sensor is remembered once so that only its
+ * latest state is sent when shedding ends.
+ ******************************************************************************/
+
+#ifndef __PRIORITY_LANES_HPP__
+#define __PRIORITY_LANES_HPP__
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "state_store.hpp"
+
+class PriorityLanes {
+  public:
+    ///Removes from a lane's queue the slots that must not be sent yet.
+    typedef std::function<void(std::vector<size_t>&)> Hold;
+
+    struct Lane {
+      int priority;
+      ///Transitions sent from this lane.
+      uint64_t sent;
+      ///Times a transition was held back for a later pass by the batch limit or the budget.
+      uint64_t deferred;
+      ///Transitions not sent because the lane was shed.
+      uint64_t shed;
+      ///Slots collected for the current pass.
+      std::vector<size_t> queued;
+      //Where the next limited pass starts
+      size_t cursor;
+    };
+
+  private:
+    std::map<std::string, uint8_t> solution_lanes;
+    std::vector<Lane> lanes;
+    //Lane of priority 0, for solutions without a priority
+    uint8_t default_lane;
+    std::vector<uint8_t> slot_lanes;
+    size_t batch_limit;
+    //True if the last collect left slots for a later pass
+    bool held_back;
+    //Slots waiting at the start of the last collect, shed and held ones excepted
+    size_t waiting;
+    //Slots the last collect held back for want of budget
+    size_t limited;
+    //Lanes below this priority are shed
+    int shed_below;
+    //Slots whose change was shed, each listed once
+    std::vector<size_t> shed_slots;
+    std::vector<bool> is_shed;
+
+    //Keep the first slots of a lane's queue from its cursor on and mark the
+    //rest dirty again
+    void holdBack(Lane& lane, size_t keep, StateStore& states);
+
+  public:
+    /**
+     * @param priorities The priority of each solution. Higher is sent first.
+     * @param batch_limit Most transitions of a lane with a priority of 0 or
+     *                    below sent in one pass, 0 for no limit.
+     */
+    PriorityLanes(const std::map<std::string, int>& priorities, size_t batch_limit);
+
+    ///Make room for at least the given number of sensor slots.
+    void resize(size_t slots);
+
+    ///Put a slot in the lane of its solution.
+    void assign(size_t slot, const std::string& solution);
+
+    ///The lanes, highest priority first.
+    std::vector<Lane>& laneList() { return lanes; }
+    const std::vector<Lane>& laneList() const { return lanes; }
+
+    /**
+     * Take the dirty slots of the state store into the queues of their
+     * lanes. Slots over the batch limit of a lane, or over the budget of
+     * the whole pass, are marked dirty again. The budget goes to the
+     * highest lanes first, and lanes above priority 0 are queued in full
+     * even past it.
+     * @param budget Most slots to queue, such as the tokens of a rate limit.
+     * @param hold Applied to each lane's queue before the limits, so that
+     *             held slots take no part of the budget.
+     * @return The number of slots queued.
+     */
+    size_t collect(StateStore& states, size_t budget = SIZE_MAX, const Hold& hold = Hold());
+
+    ///True if the last collect held slots back for a later pass.
+    bool heldBack() const { return held_back; }
+
+    ///Transitions that were waiting to be sent when the last collect began.
+    size_t lastWaiting() const { return waiting; }
+
+    ///Transitions the last collect held back because the budget ran out.
+    size_t lastLimited() const { return limited; }
+
+    /**
+     * Shed the lanes with a priority below the given one, INT_MIN to shed
+     * nothing. Sensors shed by lanes that are no longer shed are marked
+     * dirty again so that their latest state is sent.
+     */
+    void shedBelow(int priority, StateStore& states);
+
+    ///Sensors whose latest change is waiting for shedding to end.
+    size_t shedCount() const { return shed_slots.size(); }
+
+    /**
+     * Mark the queued slots of a lane and of every lane after it dirty
+     * again, for instance when sending failed, and empty their queues.
+     */
+    void requeue(size_t lane, StateStore& states);
+};
+
+#endif //__PRIORITY_LANES_HPP__
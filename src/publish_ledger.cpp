@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "publish_ledger.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+  std::string errorString(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + strerror(errno);
+  }
+}
+
+PublishLedger::PublishLedger(const std::string& path) : path(path), base(1), unacked(0), saved(1) {
+  std::ifstream file(path.c_str());
+  if (not file) {
+    if (ENOENT == errno) {
+      return;
+    }
+    throw std::runtime_error(errorString("Could not open publish checkpoint", path));
+  }
+  if (not (file>>base) or 0 == base) {
+    throw std::runtime_error("Corrupt publish checkpoint " + path);
+  }
+  saved = base;
+}
+
+std::string PublishLedger::keyOf(const std::string& uri, const std::string& solution) {
+  std::string key = uri;
+  key.push_back('\0');
+  key.append(solution);
+  return key;
+}
+
+void PublishLedger::sent(uint64_t sequence, const std::string& uri, const std::string& solution,
+                         int64_t publish_time) {
+  if (sequence < base) {
+    return;
+  }
+  //Sequence numbers are normally contiguous; anything skipped needs no ack
+  while (base + acked.size() < sequence) {
+    acked.push_back(true);
+  }
+  if (base + acked.size() == sequence) {
+    acked.push_back(false);
+    ++unacked;
+  }
+  waiting[keyOf(uri, solution)].push_back(std::make_pair(sequence, publish_time));
+  advance();
+}
+
+size_t PublishLedger::acknowledge(const std::string& uri, const std::string& solution,
+                                  int64_t stored_time) {
+  auto I = waiting.find(keyOf(uri, solution));
+  if (waiting.end() == I) {
+    return 0;
+  }
+  size_t count = 0;
+  std::deque<std::pair<uint64_t, int64_t>>& pending = I->second;
+  while (not pending.empty() and pending.front().second <= stored_time) {
+    uint64_t sequence = pending.front().first;
+    if (sequence >= base and sequence - base < acked.size()) {
+      if (not acked[sequence - base]) {
+        --unacked;
+      }
+      acked[sequence - base] = true;
+      ++count;
+    }
+    pending.pop_front();
+  }
+  if (pending.empty()) {
+    waiting.erase(I);
+  }
+  advance();
+  return count;
+}
+
+void PublishLedger::advance() {
+  while (not acked.empty() and acked.front()) {
+    acked.pop_front();
+    ++base;
+  }
+}
+
+void PublishLedger::save(uint64_t limit) {
+  uint64_t position = std::min(base, limit);
+  if (position <= saved) {
+    return;
+  }
+  std::string temp = path + ".tmp";
+  std::string contents = std::to_string(position) + "\n";
+  int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (0 > fd) {
+    throw std::runtime_error(errorString("Could not create publish checkpoint", temp));
+  }
+  bool ok = ssize_t(contents.size()) == write(fd, contents.data(), contents.size()) and 0 == fsync(fd);
+  std::string err = errorString("Could not write publish checkpoint", temp);
+  close(fd);
+  if (not ok) {
+    throw std::runtime_error(err);
+  }
+  if (0 != rename(temp.c_str(), path.c_str())) {
+    throw std::runtime_error(errorString("Could not replace publish checkpoint", path));
+  }
+  saved = position;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file publish_ledger.hpp
+ * Track which journaled transitions the world model has acknowledged and
+ * checkpoint the position below which every transition is acknowledged.
+ *
+ * Every published transition carries the sequence number that the journal
+ * gave it. The world model does not acknowledge solver data directly, so
+ * the solver subscribes to its own solutions: when the world model reports
+ * a solution of ours stored at time t, every transition of that object and
+ * solution published at or before t has arrived. After a crash only the
+ * journal from the checkpoint on needs to be republished. Republishing a
+ * transition with its original time is idempotent in the world model.
+ ******************************************************************************/
+
+#ifndef __PUBLISH_LEDGER_HPP__
+#define __PUBLISH_LEDGER_HPP__
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+class PublishLedger {
+  private:
+    std::string path;
+    //Sequence number of the first transition in the window
+    uint64_t base;
+    //Whether each transition from base on was acknowledged
+    std::deque<bool> acked;
+    //Entries of acked that are false
+    size_t unacked;
+    //Sequence number and publish time of the unacknowledged transitions of
+    //each object and solution, in publish order
+    std::unordered_map<std::string, std::deque<std::pair<uint64_t, int64_t>>> waiting;
+    uint64_t saved;
+
+    static std::string keyOf(const std::string& uri, const std::string& solution);
+    ///Move the checkpoint over the acknowledged start of the window.
+    void advance();
+
+  public:
+    /**
+     * Load the checkpoint from the given file. Without a file every
+     * transition from sequence number 1 on is unacknowledged.
+     * Throws std::runtime_error if the file exists but cannot be read.
+     */
+    PublishLedger(const std::string& path);
+
+    ///Every transition before this sequence number was acknowledged.
+    uint64_t checkpoint() const { return base; }
+
+    ///Number of published transitions waiting for acknowledgement.
+    size_t inFlight() const { return unacked; }
+
+    ///Transitions from the checkpoint on, acknowledged or not.
+    size_t windowSize() const { return acked.size(); }
+
+    ///Remember a published transition until it is acknowledged.
+    void sent(uint64_t sequence, const std::string& uri, const std::string& solution,
+              int64_t publish_time);
+
+    /**
+     * The world model stored a solution of ours at the given time, which
+     * acknowledges every transition of that object and solution published
+     * at or before it.
+     * @return The number of transitions acknowledged.
+     */
+    size_t acknowledge(const std::string& uri, const std::string& solution, int64_t stored_time);
+
+    /**
+     * Save the checkpoint if it moved, but never past limit, the first
+     * sequence number that is not yet durable in the journal.
+     * Throws std::runtime_error if the checkpoint cannot be written.
+     */
+    void save(uint64_t limit);
+};
+
+#endif //__PUBLISH_LEDGER_HPP__
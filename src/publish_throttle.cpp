@@ -0,0 +1,184 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "publish_throttle.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+const uint8_t PublishThrottle::no_class;
+const uint32_t PublishThrottle::no_slot;
+
+PublishThrottle::PublishThrottle(int64_t tick_ms, size_t wheel_size) :
+  tick_ms(tick_ms), buckets(wheel_size, no_slot), current_tick(0), num_held(0), stopped(false) {
+  if (0 == wheel_size or 0 != (wheel_size & (wheel_size - 1))) {
+    throw std::invalid_argument("The timer wheel size must be a power of two");
+  }
+}
+
+void PublishThrottle::addClass(const std::string& solution, int64_t interval_ms) {
+  if (no_class == classes.size()) {
+    throw std::invalid_argument("Too many publish interval classes");
+  }
+  classes.push_back(Class{solution, interval_ms, 0});
+}
+
+void PublishThrottle::resize(size_t slots) {
+  //Without classes nothing is ever held
+  if (enabled() and timers.size() < slots) {
+    timers.resize(slots, Timer{INT64_MIN, no_slot, no_slot, no_slot, no_class});
+  }
+}
+
+int64_t PublishThrottle::deadline(uint32_t slot) const {
+  return timers[slot].last_sent + classes[timers[slot].cls].interval_ms;
+}
+
+void PublishThrottle::schedule(uint32_t slot) {
+  Timer& timer = timers[slot];
+  //Round up so that the interval has ended when its tick is advanced over
+  int64_t tick = std::max((deadline(slot) + tick_ms - 1) / tick_ms, current_tick + 1);
+  timer.bucket = tick & (buckets.size() - 1);
+  uint32_t& head = buckets[timer.bucket];
+  timer.prev = no_slot;
+  timer.next = head;
+  if (no_slot != head) {
+    timers[head].prev = slot;
+  }
+  head = slot;
+  ++num_held;
+}
+
+void PublishThrottle::cancel(uint32_t slot) {
+  Timer& timer = timers[slot];
+  if (no_slot == timer.bucket) {
+    return;
+  }
+  if (no_slot != timer.prev) {
+    timers[timer.prev].next = timer.next;
+  }
+  else {
+    buckets[timer.bucket] = timer.next;
+  }
+  if (no_slot != timer.next) {
+    timers[timer.next].prev = timer.prev;
+  }
+  timer.bucket = no_slot;
+  timer.prev = no_slot;
+  timer.next = no_slot;
+  --num_held;
+}
+
+void PublishThrottle::assign(size_t slot, const std::string& solution) {
+  forget(slot);
+  for (size_t cls = 0; cls < classes.size(); ++cls) {
+    if (classes[cls].solution == solution) {
+      timers[slot].cls = cls;
+      timers[slot].last_sent = INT64_MIN;
+      return;
+    }
+  }
+}
+
+void PublishThrottle::forget(size_t slot) {
+  if (slot >= timers.size() or no_class == timers[slot].cls) {
+    return;
+  }
+  cancel(slot);
+  timers[slot].cls = no_class;
+}
+
+size_t PublishThrottle::filter(std::vector<size_t>& slots, int64_t now) {
+  if (not enabled() or stopped) {
+    return 0;
+  }
+  size_t kept = 0;
+  for (size_t slot : slots) {
+    if (slot < timers.size() and no_class != timers[slot].cls) {
+      Timer& timer = timers[slot];
+      Class& cls = classes[timer.cls];
+      //A held sensor already waits for the end of its interval
+      if (no_slot != timer.bucket or timer.last_sent > now - cls.interval_ms) {
+        if (no_slot == timer.bucket) {
+          schedule(slot);
+        }
+        ++cls.held;
+        continue;
+      }
+    }
+    slots[kept++] = slot;
+  }
+  size_t held = slots.size() - kept;
+  slots.resize(kept);
+  return held;
+}
+
+void PublishThrottle::sent(const std::vector<size_t>& slots, int64_t now) {
+  if (not enabled()) {
+    return;
+  }
+  for (size_t slot : slots) {
+    if (slot < timers.size() and no_class != timers[slot].cls) {
+      timers[slot].last_sent = now;
+    }
+  }
+}
+
+size_t PublishThrottle::advance(int64_t now, StateStore& states) {
+  int64_t now_tick = now / tick_ms;
+  if (0 == num_held) {
+    current_tick = std::max(current_tick, now_tick);
+    return 0;
+  }
+  //Going around the wheel once visits every bucket
+  int64_t tick = std::max(current_tick + 1, now_tick - int64_t(buckets.size()) + 1);
+  size_t released = 0;
+  for (; tick <= now_tick; ++tick) {
+    uint32_t slot = buckets[tick & (buckets.size() - 1)];
+    while (no_slot != slot) {
+      uint32_t next = timers[slot].next;
+      //Deadlines further out wait for a later turn of the wheel
+      if (deadline(slot) <= tick * tick_ms) {
+        cancel(slot);
+        //A sensor that was removed meanwhile has nothing left to send
+        if (states.isKnown(slot)) {
+          states.markDirty(slot);
+        }
+        ++released;
+      }
+      slot = next;
+    }
+  }
+  current_tick = std::max(current_tick, now_tick);
+  return released;
+}
+
+void PublishThrottle::stop(StateStore& states) {
+  stopped = true;
+  for (uint32_t& head : buckets) {
+    while (no_slot != head) {
+      uint32_t slot = head;
+      cancel(slot);
+      if (states.isKnown(slot)) {
+        states.markDirty(slot);
+      }
+    }
+  }
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file publish_throttle.hpp
+ * A minimum interval between the publishes of each sensor, per solution,
+ * for consumers that only need a state every so often.
+ *
+ * A sensor whose solution has an interval is published at once if its last
+ * publish was at least the interval ago. Otherwise it is held: its deadline,
+ * the end of the interval, is scheduled in a hashed timer wheel and its
+ * later changes coalesce in the state store. When the wheel passes the
+ * deadline the sensor is marked dirty again and its latest state is
+ * published, so each sensor is written at most once per interval and its
+ * final state is always sent.
+ ******************************************************************************/
+
+#ifndef __PUBLISH_THROTTLE_HPP__
+#define __PUBLISH_THROTTLE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "huge_pages.hpp"
+#include "state_store.hpp"
+
+class PublishThrottle {
+  public:
+    ///Sensors of one solution and their minimum interval.
+    struct Class {
+      std::string solution;
+      int64_t interval_ms;
+      ///Changes held until the end of an interval.
+      uint64_t held;
+    };
+
+    static const uint8_t no_class = UINT8_MAX;
+
+  private:
+    static const uint32_t no_slot = UINT32_MAX;
+
+    struct Timer {
+      int64_t last_sent;
+      //The wheel bucket and neighbours in it while the sensor is held
+      uint32_t bucket;
+      uint32_t prev;
+      uint32_t next;
+      uint8_t cls;
+    };
+
+    int64_t tick_ms;
+    std::vector<Class> classes;
+    std::vector<Timer, huge_pages::Allocator<Timer>> timers;
+    std::vector<uint32_t> buckets;
+    //The last tick that was advanced over
+    int64_t current_tick;
+    size_t num_held;
+    bool stopped;
+
+    int64_t deadline(uint32_t slot) const;
+    void schedule(uint32_t slot);
+    void cancel(uint32_t slot);
+
+  public:
+    /**
+     * @param tick_ms The resolution of the deadlines.
+     * @param wheel_size Number of buckets, a power of two. Deadlines further
+     *                   out than the wheel covers wait for later turns.
+     */
+    PublishThrottle(int64_t tick_ms = 10, size_t wheel_size = 4096);
+
+    ///Publish each sensor of the solution at most once every interval_ms.
+    void addClass(const std::string& solution, int64_t interval_ms);
+
+    const std::vector<Class>& classList() const { return classes; }
+
+    ///True if any solution has an interval.
+    bool enabled() const { return not classes.empty(); }
+
+    ///Make room for at least the given number of sensor slots.
+    void resize(size_t slots);
+
+    ///Put a slot in the class of its solution, if there is one.
+    void assign(size_t slot, const std::string& solution);
+
+    ///Forget a sensor, dropping a held change.
+    void forget(size_t slot);
+
+    /**
+     * Remove from slots the sensors published less than their interval
+     * before now and hold them until the interval ends.
+     * @return The number of slots held.
+     */
+    size_t filter(std::vector<size_t>& slots, int64_t now);
+
+    ///Record the sensors as published now, once sending them succeeded.
+    void sent(const std::vector<size_t>& slots, int64_t now);
+
+    /**
+     * Mark the held sensors whose interval ended by now dirty again.
+     * @return The number of sensors released.
+     */
+    size_t advance(int64_t now, StateStore& states);
+
+    ///Number of sensors currently held.
+    size_t heldCount() const { return num_held; }
+
+    /**
+     * Mark every held sensor dirty again and hold no more, for instance to
+     * publish the final states before shutting down.
+     */
+    void stop(StateStore& states);
+};
+
+#endif //__PUBLISH_THROTTLE_HPP__
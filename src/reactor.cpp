@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "reactor.hpp"
+#include "epoll_reactor.hpp"
+#include "uring_reactor.hpp"
+
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+std::unique_ptr<Reactor> Reactor::create(const std::string& backend) {
+  if ("epoll" == backend) {
+    return std::unique_ptr<Reactor>(new EpollReactor());
+  }
+  if ("io_uring" != backend and "auto" != backend) {
+    throw std::runtime_error("Unknown reactor backend " + backend);
+  }
+#ifdef BSS_HAVE_IO_URING
+  try {
+    return std::unique_ptr<Reactor>(new UringReactor());
+  }
+  catch (std::runtime_error& err) {
+    if ("io_uring" == backend) {
+      throw;
+    }
+  }
+#else
+  if ("io_uring" == backend) {
+    throw std::runtime_error("This solver was built without io_uring support");
+  }
+#endif
+  return std::unique_ptr<Reactor>(new EpollReactor());
+}
+
+bool Reactor::enableBusyPoll(int fd, int usec) {
+#ifdef SO_BUSY_POLL
+  return 0 == setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+#else
+  (void)fd;
+  (void)usec;
+  return false;
+#endif
+}
+
+bool Reactor::setNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return -1 != flags and -1 != fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+IdlePolicy::IdlePolicy(unsigned int spin_budget, int park_ms) :
+  spin_budget(spin_budget), spins(0), park_ms(park_ms) {
+}
+
+void IdlePolicy::idle(bool did_work, Reactor& reactor) {
+  if (did_work) {
+    spins = 0;
+    return;
+  }
+  if (spins < spin_budget) {
+    ++spins;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+    return;
+  }
+  //Out of spins, so sleep until an event arrives or the park time is up
+  spins = 0;
+  reactor.wait(park_ms);
+}
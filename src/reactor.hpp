@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file reactor.hpp
+ * Event loop for the file descriptors owned by the solver, and the policy
+ * that decides how a thread waits when it has no work: spin for a bounded
+ * number of polls and then block in the reactor until something happens.
+ *
+ * There are two backends behind the same interface: one built on epoll and
+ * one built on io_uring, which receives with multishot receives into a
+ * registered buffer ring and submits all queued sends with a single system
+ * call. The io_uring backend is chosen at run time if the kernel supports
+ * it.
+ ******************************************************************************/
+
+#ifndef __REACTOR_HPP__
+#define __REACTOR_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+class Reactor {
+  protected:
+    //System calls made by the backend, so that backends can be compared
+    uint64_t num_syscalls;
+
+  public:
+    /**
+     * Called with data received from a stream socket. A null pointer and a
+     * length of zero mean that the connection was closed or failed, after
+     * which the descriptor is no longer watched.
+     */
+    typedef std::function<void(const char* data, size_t length)> DataHandler;
+
+    Reactor() : num_syscalls(0) {}
+    virtual ~Reactor() {}
+
+    /**
+     * Call on_readable from wait() whenever fd becomes readable.
+     * Throws std::runtime_error if the descriptor cannot be watched.
+     */
+    virtual void add(int fd, std::function<void()> on_readable) = 0;
+
+    /**
+     * Read everything that arrives on a stream socket and pass it to
+     * on_data from wait(). The socket is made non-blocking.
+     * Throws std::runtime_error if the descriptor cannot be watched.
+     */
+    virtual void addReceiver(int fd, DataHandler on_data) = 0;
+
+    ///Stop watching a descriptor and drop any data still queued for it.
+    virtual void remove(int fd) = 0;
+
+    /**
+     * Queue data to be written to a socket. Queued data is submitted at the
+     * start of the next wait() so that many sends share system calls.
+     */
+    virtual void send(int fd, const char* data, size_t length) = 0;
+
+    ///Bytes queued for a socket that have not been written yet.
+    virtual size_t pendingBytes(int fd) const = 0;
+
+    /**
+     * Submit queued sends, then wait up to timeout_ms milliseconds (-1 for
+     * no limit) for events and call their handlers.
+     * @return The number of handlers that were called.
+     */
+    virtual int wait(int timeout_ms) = 0;
+
+    ///Name of the backend.
+    virtual const char* name() const = 0;
+
+    ///System calls made by this reactor so far.
+    uint64_t syscalls() const { return num_syscalls; }
+
+    /**
+     * Create a reactor. The backend may be "epoll", "io_uring", or "auto",
+     * which uses io_uring when the kernel supports it and epoll otherwise.
+     * Throws std::runtime_error if the requested backend is unavailable.
+     */
+    static std::unique_ptr<Reactor> create(const std::string& backend);
+
+    /**
+     * Ask the kernel to busy poll the device queue of a socket for up to
+     * usec microseconds on blocking reads (SO_BUSY_POLL).
+     * @return false if the option is unavailable or not permitted.
+     */
+    static bool enableBusyPoll(int fd, int usec);
+
+    ///Put a descriptor into non-blocking mode.
+    static bool setNonBlocking(int fd);
+};
+
+/**
+ * How a polling thread idles. After each pass over its inputs the thread
+ * reports whether it found work. Without work it spins for up to
+ * spin_budget passes and then blocks in the reactor for up to park_ms
+ * milliseconds. A spin budget of zero is the event driven mode.
+ */
+class IdlePolicy {
+  private:
+    unsigned int spin_budget;
+    unsigned int spins;
+    int park_ms;
+
+  public:
+    IdlePolicy(unsigned int spin_budget, int park_ms);
+
+    ///Called after every pass of the polling loop.
+    void idle(bool did_work, Reactor& reactor);
+
+    ///True if this policy spins before blocking.
+    bool busyPolling() const { return 0 < spin_budget; }
+};
+
+#endif //__REACTOR_HPP__
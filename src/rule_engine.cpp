@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include "rule_engine.hpp"
+
+const uint32_t RuleEngine::no_link;
+
+struct RuleEngine::Cursor {
+  const Output& output;
+  size_t pos;
+  std::vector<uint8_t>& state;
+
+  [[noreturn]] void fail(const std::string& message) const {
+    throw std::invalid_argument("Rule " + output.uri + ":" + output.solution + ": " + message +
+        " at position " + std::to_string(pos) + " of '" + output.expression + "'");
+  }
+
+  static bool isWordChar(char c) {
+    return not (isspace(c) or '(' == c or ')' == c or ',' == c);
+  }
+
+  void skipSpace() {
+    while (pos < output.expression.size() and isspace(output.expression[pos])) {
+      ++pos;
+    }
+  }
+
+  ///The next token, which is a word or one of ( ) and , or empty at the end.
+  std::string peek() {
+    skipSpace();
+    const std::string& text = output.expression;
+    if (pos == text.size()) {
+      return std::string();
+    }
+    if (not isWordChar(text[pos])) {
+      return text.substr(pos, 1);
+    }
+    size_t end = pos;
+    while (end < text.size() and isWordChar(text[end])) {
+      ++end;
+    }
+    return text.substr(pos, end - pos);
+  }
+
+  std::string next() {
+    std::string token = peek();
+    pos += token.size();
+    return token;
+  }
+
+  void expect(const std::string& token) {
+    if (peek() != token) {
+      fail("expected '" + token + "'");
+    }
+    next();
+  }
+
+  ///A solution name or URI.
+  std::string name() {
+    std::string token = peek();
+    if (token.empty() or not isWordChar(token[0])) {
+      fail("expected a name");
+    }
+    next();
+    return token;
+  }
+};
+
+RuleEngine::RuleEngine() : free_links(no_link) {
+}
+
+std::string RuleEngine::keyOf(char match, const std::string& solution, const std::string& uri) {
+  std::string key(1, match);
+  key.append(solution);
+  key.push_back('\0');
+  key.append(uri);
+  return key;
+}
+
+bool RuleEngine::evaluate(const Node& node) {
+  switch (node.kind) {
+    case Kind::constant:
+      return node.value;
+    case Kind::any_input:
+    case Kind::or_node:
+      return 0 < node.true_inputs;
+    case Kind::all_input:
+      return 0 < node.inputs and node.true_inputs == node.inputs;
+    case Kind::not_node:
+      return 0 == node.true_inputs;
+    case Kind::and_node:
+      return node.true_inputs == node.inputs;
+  }
+  return false;
+}
+
+uint32_t RuleEngine::addNode(Kind kind, const std::vector<uint32_t>& children, bool value) {
+  uint32_t index = nodes.size();
+  Node node{kind, value, Kind::constant == kind, 0, uint32_t(children.size()), 0, {}, {}};
+  for (uint32_t child : children) {
+    nodes[child].parents.push_back(index);
+    if (nodes[child].value) {
+      ++node.true_inputs;
+    }
+    if (not nodes[child].known) {
+      ++node.unknown_children;
+    }
+  }
+  node.value = evaluate(node);
+  if (not children.empty()) {
+    node.known = 0 == node.unknown_children;
+  }
+  nodes.push_back(node);
+  return index;
+}
+
+uint32_t RuleEngine::inputNode(char match, const std::string& solution, const std::string& uri) {
+  std::string key = keyOf(match, solution, uri);
+  auto I = input_index.find(key);
+  if (input_index.end() != I) {
+    return I->second;
+  }
+  //Exact references are any inputs over the sensors of a single object
+  uint32_t index = addNode('l' == match ? Kind::all_input : Kind::any_input, {});
+  input_index[key] = index;
+  if ('=' != match and prefix_lengths.end() ==
+      std::find(prefix_lengths.begin(), prefix_lengths.end(), uri.size())) {
+    prefix_lengths.push_back(uri.size());
+  }
+  return index;
+}
+
+void RuleEngine::addRule(const std::string& uri, const std::string& solution, const std::string& expression) {
+  std::string key = keyOf('=', solution, uri);
+  if (output_index.end() != output_index.find(key)) {
+    throw std::invalid_argument("More than one rule produces " + uri + ":" + solution);
+  }
+  output_index[key] = outputs.size();
+  outputs.push_back(Output{uri, solution, expression, 0, false});
+}
+
+void RuleEngine::compile() {
+  //0 is not compiled, 1 is being compiled and 2 is done
+  std::vector<uint8_t> state(outputs.size(), 0);
+  for (uint32_t output = 0; output < outputs.size(); ++output) {
+    compileOutput(output, state);
+  }
+  //A rule that needs no sensor has its first result now
+  for (uint32_t output = 0; output < outputs.size(); ++output) {
+    if (nodes[outputs[output].node].known) {
+      markDirty(output);
+    }
+  }
+}
+
+uint32_t RuleEngine::compileOutput(uint32_t output, std::vector<uint8_t>& state) {
+  if (2 == state[output]) {
+    return outputs[output].node;
+  }
+  Cursor cursor{outputs[output], 0, state};
+  if (1 == state[output]) {
+    cursor.fail("rules depend on each other in a cycle");
+  }
+  state[output] = 1;
+  uint32_t node = parseOr(cursor);
+  if (not cursor.peek().empty()) {
+    cursor.fail("unexpected '" + cursor.peek() + "'");
+  }
+  outputs[output].node = node;
+  nodes[node].outputs.push_back(output);
+  state[output] = 2;
+  return node;
+}
+
+uint32_t RuleEngine::parseOr(Cursor& cursor) {
+  std::vector<uint32_t> children{parseAnd(cursor)};
+  while ("or" == cursor.peek()) {
+    cursor.next();
+    children.push_back(parseAnd(cursor));
+  }
+  return 1 == children.size() ? children[0] : addNode(Kind::or_node, children);
+}
+
+uint32_t RuleEngine::parseAnd(Cursor& cursor) {
+  std::vector<uint32_t> children{parseUnary(cursor)};
+  while ("and" == cursor.peek()) {
+    cursor.next();
+    children.push_back(parseUnary(cursor));
+  }
+  return 1 == children.size() ? children[0] : addNode(Kind::and_node, children);
+}
+
+uint32_t RuleEngine::parseUnary(Cursor& cursor) {
+  if ("not" == cursor.peek()) {
+    cursor.next();
+    return addNode(Kind::not_node, {parseUnary(cursor)});
+  }
+  return parsePrimary(cursor);
+}
+
+uint32_t RuleEngine::parsePrimary(Cursor& cursor) {
+  std::string token = cursor.peek();
+  if ("(" == token) {
+    cursor.next();
+    uint32_t node = parseOr(cursor);
+    cursor.expect(")");
+    return node;
+  }
+  if ("true" == token or "false" == token) {
+    cursor.next();
+    return addNode(Kind::constant, {}, "true" == token);
+  }
+  if (token.empty() or "and" == token or "or" == token or not Cursor::isWordChar(token[0])) {
+    cursor.fail(token.empty() ? "unexpected end" : "unexpected '" + token + "'");
+  }
+  std::string solution = cursor.name();
+  cursor.expect("(");
+  if ("any" == token or "all" == token) {
+    std::string kind_solution = cursor.name();
+    cursor.expect(",");
+    std::string prefix = cursor.name();
+    cursor.expect(")");
+    return inputNode("all" == token ? 'l' : 'y', kind_solution, prefix);
+  }
+  std::string uri = cursor.name();
+  cursor.expect(")");
+  //Another rule's result if a rule produces this solution
+  auto I = output_index.find(keyOf('=', solution, uri));
+  if (output_index.end() != I) {
+    return compileOutput(I->second, cursor.state);
+  }
+  return inputNode('=', solution, uri);
+}
+
+void RuleEngine::markDirty(uint32_t output) {
+  if (not outputs[output].dirty) {
+    outputs[output].dirty = true;
+    dirty_outputs.push_back(output);
+  }
+}
+
+void RuleEngine::refresh(uint32_t index) {
+  Node& node = nodes[index];
+  bool value = evaluate(node);
+  bool input = Kind::any_input == node.kind or Kind::all_input == node.kind;
+  //Known stays set, so a result is never withdrawn once it was published
+  bool now_known = not node.known and (input ? 0 < node.inputs : 0 == node.unknown_children);
+  if (value == node.value and not now_known) {
+    return;
+  }
+  bool changed = value != node.value;
+  node.value = value;
+  node.known = node.known or now_known;
+  if (node.known) {
+    for (uint32_t output : node.outputs) {
+      markDirty(output);
+    }
+  }
+  for (uint32_t parent : node.parents) {
+    if (changed and value) {
+      ++nodes[parent].true_inputs;
+    }
+    else if (changed) {
+      --nodes[parent].true_inputs;
+    }
+    if (now_known) {
+      --nodes[parent].unknown_children;
+    }
+    refresh(parent);
+  }
+}
+
+void RuleEngine::link(size_t slot, uint32_t node) {
+  uint32_t index = free_links;
+  if (no_link == index) {
+    index = links.size();
+    links.push_back(Link{node, slot_links[slot]});
+  }
+  else {
+    free_links = links[index].next;
+    links[index] = Link{node, slot_links[slot]};
+  }
+  slot_links[slot] = index;
+}
+
+void RuleEngine::assign(size_t slot, const std::string& uri, const std::string& solution) {
+  forget(slot);
+  if (slot_links.size() <= slot) {
+    slot_links.resize(slot + 1, no_link);
+    slot_states.resize(slot + 1, none);
+  }
+  auto I = input_index.find(keyOf('=', solution, uri));
+  if (input_index.end() != I) {
+    link(slot, I->second);
+  }
+  for (size_t length : prefix_lengths) {
+    if (length > uri.size()) {
+      continue;
+    }
+    std::string prefix = uri.substr(0, length);
+    for (char match : {'y', 'l'}) {
+      I = input_index.find(keyOf(match, solution, prefix));
+      if (input_index.end() != I) {
+        link(slot, I->second);
+      }
+    }
+  }
+}
+
+void RuleEngine::addMember(size_t slot, int delta_inputs, int delta_true) {
+  for (uint32_t index = slot_links[slot]; no_link != index; index = links[index].next) {
+    Node& node = nodes[links[index].node];
+    node.inputs += delta_inputs;
+    node.true_inputs += delta_true;
+    refresh(links[index].node);
+  }
+}
+
+void RuleEngine::forget(size_t slot) {
+  if (slot >= slot_links.size() or no_link == slot_links[slot]) {
+    return;
+  }
+  if (none != slot_states[slot]) {
+    addMember(slot, -1, is_true == slot_states[slot] ? -1 : 0);
+  }
+  //Return the slot's links to the free list
+  uint32_t last = slot_links[slot];
+  while (no_link != links[last].next) {
+    last = links[last].next;
+  }
+  links[last].next = free_links;
+  free_links = slot_links[slot];
+  slot_links[slot] = no_link;
+  slot_states[slot] = none;
+}
+
+void RuleEngine::update(size_t slot, bool value) {
+  if (slot >= slot_links.size() or no_link == slot_links[slot]) {
+    return;
+  }
+  uint8_t state = value ? is_true : is_false;
+  uint8_t old = slot_states[slot];
+  if (old == state) {
+    return;
+  }
+  slot_states[slot] = state;
+  addMember(slot, none == old ? 1 : 0, (value ? 1 : 0) - (is_true == old ? 1 : 0));
+}
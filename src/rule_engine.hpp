@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file rule_engine.hpp
+ * Derived states computed from sensor states by rules such as
+ *   winlab.room12:secure = all(closed, winlab.room12.) and not any(wet, winlab.room12.)
+ *   winlab.b1:breach = not closed(winlab.b1.door) and closed(winlab.b1)
+ *
+ * A rule names the object and solution it produces (uri:solution) and is an
+ * expression of and, or, not, parentheses, true and false over
+ *   solution(uri)            the state of the object's solution, which is
+ *                            another rule's result if a rule produces it
+ *   any(solution, prefix)    true if any object starting with prefix is true
+ *   all(solution, prefix)    true if there are such objects and all are true
+ * Only sensors with a known state are counted, as in the group aggregates,
+ * so a sensor that is not known yet is false. A rule is first published
+ * once every input it reads has at least one sensor with a known state, so
+ * that a result computed before the sensors are mapped never goes out, and
+ * then whenever its result changes.
+ *
+ * Rules are compiled into one DAG whose nodes count how many of their inputs
+ * are true. A sensor change adjusts the counts of the nodes that depend on
+ * it and walks up only while node values change, so the work per change is
+ * proportional to the affected part of the DAG rather than to the number of
+ * rules or sensors.
+ ******************************************************************************/
+
+#ifndef __RULE_ENGINE_HPP__
+#define __RULE_ENGINE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class RuleEngine {
+  public:
+    ///The result of one rule.
+    struct Output {
+      std::string uri;
+      std::string solution;
+      std::string expression;
+      uint32_t node;
+      bool dirty;
+    };
+
+  private:
+    enum class Kind : uint8_t {constant, any_input, all_input, not_node, and_node, or_node};
+
+    struct Node {
+      Kind kind;
+      bool value;
+      //Set once the node has a result worth publishing: an input when one of
+      //its sensors has a known state, any other node when all its children do
+      bool known;
+      uint32_t unknown_children;
+      //Children, or for inputs sensors with a known state, and how many are true
+      uint32_t inputs;
+      uint32_t true_inputs;
+      std::vector<uint32_t> parents;
+      //Rules whose result this node is
+      std::vector<uint32_t> outputs;
+    };
+
+    //Sensor slots feeding each input node, as linked lists in one pool
+    struct Link {
+      uint32_t node;
+      uint32_t next;
+    };
+    static const uint32_t no_link = UINT32_MAX;
+
+    //Sensor states as in GroupAggregates; only known states are counted
+    enum : uint8_t {none = 0, is_false = 1, is_true = 2};
+
+    //Position in the expression of the rule being compiled
+    struct Cursor;
+
+    std::vector<Node> nodes;
+    std::vector<Output> outputs;
+    std::vector<uint32_t> dirty_outputs;
+    //Rules by the solution and URI they produce
+    std::unordered_map<std::string, uint32_t> output_index;
+
+    //Input nodes by match (exact, any or all prefix), solution and URI
+    std::unordered_map<std::string, uint32_t> input_index;
+    //Lengths of the URI prefixes of any and all inputs, to limit the lookups
+    std::vector<size_t> prefix_lengths;
+
+    std::vector<uint32_t> slot_links;
+    std::vector<uint8_t> slot_states;
+    std::vector<Link> links;
+    uint32_t free_links;
+
+    static std::string keyOf(char match, const std::string& solution, const std::string& uri);
+    static bool evaluate(const Node& node);
+    uint32_t addNode(Kind kind, const std::vector<uint32_t>& children, bool value = false);
+    uint32_t inputNode(char match, const std::string& solution, const std::string& uri);
+    ///Compile the rule producing an output if needed and return its node.
+    uint32_t compileOutput(uint32_t output, std::vector<uint8_t>& state);
+    uint32_t parseOr(Cursor& cursor);
+    uint32_t parseAnd(Cursor& cursor);
+    uint32_t parseUnary(Cursor& cursor);
+    uint32_t parsePrimary(Cursor& cursor);
+    void link(size_t slot, uint32_t node);
+    ///Recompute a node from its counts and propagate a change of its value
+    ///or of whether it is known upwards.
+    void refresh(uint32_t node);
+    ///Add to the sensor counts of every input a slot feeds.
+    void addMember(size_t slot, int delta_inputs, int delta_true);
+
+  public:
+    RuleEngine();
+
+    /**
+     * Add a rule producing the given solution of the given object.
+     * Throws std::invalid_argument if a rule already produces it.
+     */
+    void addRule(const std::string& uri, const std::string& solution, const std::string& expression);
+
+    /**
+     * Compile every rule into the evaluation DAG. Rules over constants
+     * alone are marked dirty at once, the others when their inputs are
+     * known.
+     * Throws std::invalid_argument with the rule and position of a syntax
+     * error, or if rules depend on each other in a cycle.
+     */
+    void compile();
+
+    ///Set the object and solution of a sensor slot.
+    void assign(size_t slot, const std::string& uri, const std::string& solution);
+
+    ///Stop using a sensor in the rules.
+    void forget(size_t slot);
+
+    ///Set the state of a sensor and re-evaluate the rules that depend on it.
+    void update(size_t slot, bool value);
+
+    const std::vector<Output>& rules() const { return outputs; }
+
+    ///The current result of a rule.
+    bool value(const Output& output) const { return nodes[output.node].value; }
+
+    size_t nodeCount() const { return nodes.size(); }
+
+    ///Number of rules whose result changed since they were last drained.
+    size_t dirtyCount() const { return dirty_outputs.size(); }
+
+    ///Mark a rule as needing to be published again.
+    void markDirty(uint32_t output);
+
+    ///Call f(index, output, value) for every rule whose result changed.
+    template<typename F>
+    void drainDirty(F f) {
+      std::vector<uint32_t> drained;
+      drained.swap(dirty_outputs);
+      for (uint32_t index : drained) {
+        outputs[index].dirty = false;
+        f(index, outputs[index], nodes[outputs[index].node].value);
+      }
+    }
+};
+
+#endif //__RULE_ENGINE_HPP__
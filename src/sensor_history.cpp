@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "sensor_history.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "huge_pages.hpp"
+
+const size_t SensorHistory::block_size;
+const uint32_t SensorHistory::no_block;
+const size_t SensorHistory::chunk_blocks = huge_pages::page_size / sizeof(SensorHistory::Block);
+
+namespace {
+  //Write a varint and return its length, or 0 if it does not fit
+  size_t putDelta(uint8_t* out, size_t room, uint64_t value) {
+    size_t length = 0;
+    do {
+      if (length == room) {
+        return 0;
+      }
+      uint8_t byte = value & 0x7F;
+      value >>= 7;
+      out[length++] = byte | (0 != value ? 0x80 : 0);
+    } while (0 != value);
+    return length;
+  }
+}
+
+int64_t SensorHistory::getDelta(const uint8_t* deltas, size_t& pos) {
+  uint64_t value = 0;
+  for (int shift = 0; ; shift += 7) {
+    uint8_t byte = deltas[pos++];
+    value |= uint64_t(byte & 0x7F) << shift;
+    if (0 == (byte & 0x80)) {
+      return value;
+    }
+  }
+}
+
+SensorHistory::SensorHistory(size_t max_bytes) :
+  max_blocks(std::min<size_t>(max_bytes / block_size, no_block)), allocated(0), dropped(0) {
+}
+
+SensorHistory::~SensorHistory() {
+  for (Block* chunk : chunks) {
+    huge_pages::deallocate(chunk, chunk_blocks * sizeof(Block));
+  }
+}
+
+uint32_t SensorHistory::allocate() {
+  if (not free_blocks.empty()) {
+    uint32_t index = free_blocks.back();
+    free_blocks.pop_back();
+    return index;
+  }
+  if (allocated == max_blocks) {
+    return no_block;
+  }
+  if (allocated == chunks.size() * chunk_blocks) {
+    chunks.push_back(static_cast<Block*>(huge_pages::allocate(chunk_blocks * sizeof(Block))));
+  }
+  return allocated++;
+}
+
+void SensorHistory::dropOldest(Block& b) {
+  size_t pos = 0;
+  b.first_time += getDelta(b.deltas, pos);
+  b.first_value = not b.first_value;
+  memmove(b.deltas, b.deltas + pos, b.length - pos);
+  b.length -= pos;
+  --b.count;
+}
+
+void SensorHistory::record(size_t slot, bool value, int64_t time) {
+  if (slot_blocks.size() <= slot) {
+    slot_blocks.resize(slot + 1, no_block);
+  }
+  if (no_block == slot_blocks[slot]) {
+    uint32_t index = allocate();
+    if (no_block == index) {
+      ++dropped;
+      return;
+    }
+    slot_blocks[slot] = index;
+    Block& b = block(index);
+    b.first_time = time;
+    b.last_time = time;
+    b.length = 0;
+    b.count = 1;
+    b.first_value = value;
+    return;
+  }
+  Block& b = block(slot_blocks[slot]);
+  //States alternate, so a repeated state is not a transition
+  if ((0 == (b.count - 1) % 2) == (value == b.first_value)) {
+    return;
+  }
+  //Samples can arrive slightly out of order, so never go back in time
+  uint64_t delta = std::max<int64_t>(0, time - b.last_time);
+  size_t length;
+  while (0 == (length = putDelta(b.deltas + b.length, sizeof(b.deltas) - b.length, delta))) {
+    dropOldest(b);
+  }
+  b.length += length;
+  ++b.count;
+  b.last_time += delta;
+}
+
+void SensorHistory::forget(size_t slot) {
+  if (slot < slot_blocks.size() and no_block != slot_blocks[slot]) {
+    free_blocks.push_back(slot_blocks[slot]);
+    slot_blocks[slot] = no_block;
+  }
+}
+
+SensorHistory::State SensorHistory::stateAt(size_t slot, int64_t time) const {
+  State state{false, false, 0, 0};
+  if (slot >= slot_blocks.size() or no_block == slot_blocks[slot]) {
+    return state;
+  }
+  const Block& b = block(slot_blocks[slot]);
+  if (time < b.first_time) {
+    return state;
+  }
+  state.known = true;
+  state.value = b.first_value;
+  state.since = b.first_time;
+  for (size_t pos = 0; pos < b.length; ) {
+    int64_t next = state.since + getDelta(b.deltas, pos);
+    if (next > time) {
+      state.until = next;
+      break;
+    }
+    state.since = next;
+    state.value = not state.value;
+  }
+  return state;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file sensor_history.hpp
+ * The recent transitions of every sensor, kept in memory to answer
+ * questions such as "was this door open at 02:13" without a range query
+ * against the world model.
+ *
+ * Each sensor gets one cache line sized ring block from a slab the first
+ * time it changes. A block holds the time and state of its oldest
+ * transition followed by the time since the previous transition of each
+ * later one as a varint, so most transitions take one to four bytes. States
+ * alternate, so they are not stored. When a block is full the oldest
+ * transitions are dropped. The slab grows in huge page chunks up to a fixed
+ * number of blocks, which bounds the total memory; sensors that change
+ * after the slab is full have no history.
+ ******************************************************************************/
+
+#ifndef __SENSOR_HISTORY_HPP__
+#define __SENSOR_HISTORY_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class SensorHistory {
+  public:
+    ///The state of a sensor at some time.
+    struct State {
+      ///False if the time is before the oldest transition kept.
+      bool known;
+      bool value;
+      ///When the sensor entered the state, and the next transition or 0 if
+      ///it is still in it.
+      int64_t since;
+      int64_t until;
+    };
+
+    static const size_t block_size = 64;
+
+  private:
+    struct Block {
+      int64_t first_time;
+      int64_t last_time;
+      //Bytes of deltas in use and number of transitions
+      uint8_t length;
+      uint8_t count;
+      bool first_value;
+      uint8_t deltas[block_size - 2 * sizeof(int64_t) - 3];
+    };
+    static_assert(sizeof(Block) == block_size, "History blocks must fill a cache line");
+
+    static const uint32_t no_block = UINT32_MAX;
+    //Blocks per slab chunk, one huge page
+    static const size_t chunk_blocks;
+
+    size_t max_blocks;
+    std::vector<Block*> chunks;
+    size_t allocated;
+    std::vector<uint32_t> free_blocks;
+    std::vector<uint32_t> slot_blocks;
+    size_t dropped;
+
+    Block& block(uint32_t index) const {
+      return chunks[index / chunk_blocks][index % chunk_blocks];
+    }
+    uint32_t allocate();
+    ///Drop the oldest transition of a block.
+    void dropOldest(Block& b);
+
+  public:
+    ///@param max_bytes The most memory to use for history blocks.
+    SensorHistory(size_t max_bytes);
+    ~SensorHistory();
+
+    SensorHistory(const SensorHistory&) = delete;
+    SensorHistory& operator=(const SensorHistory&) = delete;
+
+    ///Record that a sensor entered a state at the given time.
+    void record(size_t slot, bool value, int64_t time);
+
+    ///Forget the history of a sensor and give its block back to the slab.
+    void forget(size_t slot);
+
+    ///The state of a sensor at the given time.
+    State stateAt(size_t slot, int64_t time) const;
+
+    /**
+     * Call f(time, value) for up to n of the latest transitions of a
+     * sensor, latest first.
+     */
+    template<typename F>
+    void recent(size_t slot, size_t n, F f) const {
+      if (slot >= slot_blocks.size() or no_block == slot_blocks[slot]) {
+        return;
+      }
+      const Block& b = block(slot_blocks[slot]);
+      std::vector<int64_t> times(1, b.first_time);
+      for (size_t pos = 0; pos < b.length; ) {
+        times.push_back(times.back() + getDelta(b.deltas, pos));
+      }
+      for (size_t i = times.size(); 0 < i and times.size() - i < n; --i) {
+        f(times[i - 1], (0 == (i - 1) % 2) == b.first_value);
+      }
+    }
+
+    ///Bytes of history blocks in use and the most that may be used.
+    size_t bytesUsed() const { return (allocated - free_blocks.size()) * block_size; }
+    size_t bytesLimit() const { return max_blocks * block_size; }
+
+    ///Transitions that were not recorded because the slab was full.
+    size_t droppedTransitions() const { return dropped; }
+
+    ///Read the varint delta at pos and move pos past it.
+    static int64_t getDelta(const uint8_t* deltas, size_t& pos);
+};
+
+#endif //__SENSOR_HISTORY_HPP__
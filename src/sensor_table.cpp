@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "sensor_table.hpp"
+
+#include <algorithm>
+#include <functional>
+
+#include "utf8.hpp"
+
+//Number of lookups whose memory accesses are overlapped in findBatch
+static const size_t prefetch_group = 16;
+
+SensorTable::SensorTable() : buckets(16, Bucket{0, no_slot, StringArena::no_ref}), mask(15), num_used(0) {
+}
+
+uint64_t SensorTable::hashOf(const std::string& tx) {
+  return std::hash<std::string>()(tx);
+}
+
+size_t SensorTable::probe(const std::string& tx, uint64_t hash) const {
+  uint32_t tag = tagOf(hash);
+  size_t index = hash & mask;
+  while (no_slot != buckets[index].slot) {
+    const Bucket& bucket = buckets[index];
+    if (bucket.tag == tag and strings.equals(bucket.name, tx)) {
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+  return index;
+}
+
+void SensorTable::grow() {
+  std::vector<Bucket, huge_pages::Allocator<Bucket>> old;
+  old.swap(buckets);
+  buckets.assign(old.size() * 2, Bucket{0, no_slot, StringArena::no_ref});
+  mask = buckets.size() - 1;
+  for (const Bucket& bucket : old) {
+    if (no_slot != bucket.slot) {
+      size_t index = entries[bucket.slot].hash & mask;
+      while (no_slot != buckets[index].slot) {
+        index = (index + 1) & mask;
+      }
+      buckets[index] = bucket;
+    }
+  }
+}
+
+uint32_t SensorTable::solutionIndex(const std::string& solution) {
+  auto I = std::find(solution_names.begin(), solution_names.end(), solution);
+  if (solution_names.end() == I) {
+    solution_names.push_back(solution);
+    return solution_names.size() - 1;
+  }
+  return I - solution_names.begin();
+}
+
+void SensorTable::reserve(size_t count) {
+  entries.reserve(count);
+  //Room for a typical transmitter name and URI per entry
+  strings.reserve(count * 48);
+  while (count * 2 > buckets.size()) {
+    grow();
+  }
+}
+
+SensorTable::Slot SensorTable::find(const std::string& tx) const {
+  return buckets[probe(tx, hashOf(tx))].slot;
+}
+
+void SensorTable::findBatch(const std::u16string* const* keys, size_t count, Slot* slots) const {
+  uint64_t hashes[prefetch_group];
+  //Transmitter names are short enough to stay in the strings' own buffers
+  std::string names[prefetch_group];
+  for (size_t base = 0; base < count; base += prefetch_group) {
+    size_t group = std::min(prefetch_group, count - base);
+    //Hash every key in the group and prefetch its home bucket
+    for (size_t i = 0; i < group; ++i) {
+      names[i].clear();
+      utf8::append(names[i], *keys[base + i]);
+      hashes[i] = hashOf(names[i]);
+      __builtin_prefetch(&buckets[hashes[i] & mask]);
+    }
+    //Prefetch the name of the first bucket with a matching tag
+    for (size_t i = 0; i < group; ++i) {
+      uint32_t tag = tagOf(hashes[i]);
+      size_t index = hashes[i] & mask;
+      while (no_slot != buckets[index].slot) {
+        if (buckets[index].tag == tag) {
+          __builtin_prefetch(strings.data(buckets[index].name));
+          break;
+        }
+        index = (index + 1) & mask;
+      }
+    }
+    //The buckets and names should now be in cache, so finish the lookups
+    for (size_t i = 0; i < group; ++i) {
+      slots[base + i] = buckets[probe(names[i], hashes[i])].slot;
+    }
+  }
+}
+
+SensorTable::Slot SensorTable::assign(const std::string& tx, const std::string& uri,
+                                      const std::string& solution, bool& changed) {
+  uint64_t hash = hashOf(tx);
+  size_t index = probe(tx, hash);
+  uint32_t solution_index = solutionIndex(solution);
+  if (no_slot != buckets[index].slot) {
+    Entry& entry = entries[buckets[index].slot];
+    changed = entry.solution != solution_index;
+    if (not strings.equals(entry.uri, uri)) {
+      changed = true;
+      strings.release(entry.uri);
+      entry.uri = strings.add(uri);
+    }
+    entry.solution = solution_index;
+    return buckets[index].slot;
+  }
+  changed = true;
+  Entry entry{hash, strings.add(tx), strings.add(uri), solution_index, true};
+  Slot slot;
+  if (free_slots.empty()) {
+    slot = entries.size();
+    entries.push_back(entry);
+  }
+  else {
+    slot = free_slots.back();
+    free_slots.pop_back();
+    entries[slot] = entry;
+  }
+  buckets[index] = Bucket{tagOf(hash), slot, entry.transmitter};
+  ++num_used;
+  //Keep the load factor at or below one half so probe sequences stay short
+  if (num_used * 2 > buckets.size()) {
+    grow();
+  }
+  return slot;
+}
+
+SensorTable::Slot SensorTable::erase(const std::string& tx) {
+  size_t index = probe(tx, hashOf(tx));
+  Slot slot = buckets[index].slot;
+  if (no_slot == slot) {
+    return no_slot;
+  }
+  //Shift later members of the probe sequence back instead of leaving a
+  //tombstone so that lookups never have to skip deleted buckets.
+  size_t hole = index;
+  size_t next = (hole + 1) & mask;
+  while (no_slot != buckets[next].slot) {
+    size_t home = entries[buckets[next].slot].hash & mask;
+    //Move the bucket into the hole unless its home lies cyclically in (hole, next]
+    bool stays = (hole < next) ? (hole < home and home <= next) : (hole < home or home <= next);
+    if (not stays) {
+      buckets[hole] = buckets[next];
+      hole = next;
+    }
+    next = (next + 1) & mask;
+  }
+  buckets[hole] = Bucket{0, no_slot, StringArena::no_ref};
+  --num_used;
+  //Release the strings but keep the slot around for reuse
+  strings.release(entries[slot].transmitter);
+  strings.release(entries[slot].uri);
+  entries[slot] = Entry{0, StringArena::no_ref, StringArena::no_ref, 0, false};
+  free_slots.push_back(slot);
+  return slot;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file sensor_table.hpp
+ * Map transmitter names to dense sensor slots. Each slot remembers the
+ * world model object and the solution name that the transmitter drives.
+ * Slots of removed transmitters are reused so the slot space stays compact.
+ *
+ * Transmitters are found through an open addressing hash table with linear
+ * probing. Batches of lookups hash every key first and prefetch the buckets
+ * and entries they will touch so that the cache misses of a whole group of
+ * lookups overlap instead of being taken one after another.
+ *
+ * Names are kept as UTF-8 in a StringArena and each distinct solution name
+ * is stored once, so an entry is a few small integers. Callers get copies
+ * of the names.
+ ******************************************************************************/
+
+#ifndef __SENSOR_TABLE_HPP__
+#define __SENSOR_TABLE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "huge_pages.hpp"
+#include "string_arena.hpp"
+
+class SensorTable {
+  public:
+    typedef uint32_t Slot;
+    static const Slot no_slot = UINT32_MAX;
+
+  private:
+    struct Entry {
+      //Hash of the transmitter name, kept so that growing the table does
+      //not need to rehash every string.
+      uint64_t hash;
+      StringArena::Ref transmitter;
+      StringArena::Ref uri;
+      //Index into solution_names
+      uint32_t solution;
+      bool in_use;
+    };
+
+    struct Bucket {
+      //Upper bits of the hash, compared before the transmitter name.
+      uint32_t tag;
+      Slot slot;
+      //The transmitter name, so a lookup goes straight from the bucket to
+      //the name without touching the entry
+      StringArena::Ref name;
+    };
+
+    std::vector<Bucket, huge_pages::Allocator<Bucket>> buckets;
+    size_t mask;
+    size_t num_used;
+    std::vector<Entry, huge_pages::Allocator<Entry>> entries;
+    std::vector<Slot> free_slots;
+    StringArena strings;
+    //The few distinct solution names
+    std::vector<std::string> solution_names;
+
+    static uint64_t hashOf(const std::string& tx);
+    static uint32_t tagOf(uint64_t hash) { return hash >> 32; }
+
+    ///Index of the bucket holding the transmitter or of the empty bucket
+    ///where it would be inserted.
+    size_t probe(const std::string& tx, uint64_t hash) const;
+
+    uint32_t solutionIndex(const std::string& solution);
+
+    ///Double the number of buckets and reinsert every entry.
+    void grow();
+
+  public:
+    SensorTable();
+
+    /**
+     * Size the table for the given number of transmitters up front so that
+     * it does not need to grow (and fault in new memory) while running.
+     */
+    void reserve(size_t count);
+
+    ///Find the slot of a transmitter, or no_slot if it is not mapped.
+    Slot find(const std::string& tx) const;
+
+    /**
+     * Find the slots of many transmitters at once. Lookups are done in
+     * groups: the keys of a group are hashed and their buckets prefetched,
+     * then the names of the matching buckets are prefetched, and only then
+     * are the transmitter names compared.
+     * @param keys Pointers to the transmitter names to find, in UTF-16 as
+     *             they arrive from the world model.
+     * @param count The number of keys.
+     * @param slots Output array of count slots, no_slot for unknown keys.
+     */
+    void findBatch(const std::u16string* const* keys, size_t count, Slot* slots) const;
+
+    /**
+     * Map a transmitter to an object and solution, reusing its slot if it
+     * already has one.
+     * @param changed Set to true if this is a new mapping or the object or
+     *                solution of an existing mapping changed.
+     * @return The transmitter's slot.
+     */
+    Slot assign(const std::string& tx, const std::string& uri,
+                const std::string& solution, bool& changed);
+
+    ///Remove a transmitter. Returns its old slot or no_slot if not mapped.
+    Slot erase(const std::string& tx);
+
+    ///True if the slot belongs to a mapped transmitter.
+    bool inUse(Slot slot) const { return slot < entries.size() and entries[slot].in_use; }
+
+    std::string transmitter(Slot slot) const { return strings.str(entries[slot].transmitter); }
+    std::string uri(Slot slot) const { return strings.str(entries[slot].uri); }
+    const std::string& solution(Slot slot) const { return solution_names[entries[slot].solution]; }
+
+    ///Bytes of memory holding the transmitter names and URIs.
+    size_t stringBytes() const { return strings.bytesUsed() + strings.bytesFree(); }
+
+    ///Number of slots ever handed out (the upper bound of the slot space).
+    size_t capacity() const { return entries.size(); }
+
+    ///Number of mapped transmitters.
+    size_t size() const { return num_used; }
+};
+
+#endif //__SENSOR_TABLE_HPP__
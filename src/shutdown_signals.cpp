@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "shutdown_signals.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+namespace {
+  sigset_t shutdownSignals() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    return mask;
+  }
+}
+
+ShutdownSignals::ShutdownSignals() : signal_fd(-1), received(0) {
+  sigset_t mask = shutdownSignals();
+  if (0 != pthread_sigmask(SIG_BLOCK, &mask, nullptr)) {
+    throw std::runtime_error("Could not block the shutdown signals");
+  }
+  signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (0 > signal_fd) {
+    throw std::runtime_error(std::string("Could not create a signalfd: ") + strerror(errno));
+  }
+}
+
+ShutdownSignals::~ShutdownSignals() {
+  close(signal_fd);
+}
+
+void ShutdownSignals::watch(Reactor& reactor) {
+  reactor.add(signal_fd, [this]() { check(); });
+}
+
+bool ShutdownSignals::check() {
+  signalfd_siginfo info;
+  while (sizeof(info) == read(signal_fd, &info, sizeof(info))) {
+    std::cerr<<"Received signal "<<strsignal(info.ssi_signo)<<'\n';
+    if (requested()) {
+      //This is the second time we've received the signal, so just exit.
+      std::cerr<<"Aborting.\n";
+      exit(-1);
+    }
+    std::cerr<<"Shutting down...\n";
+    ++received;
+  }
+  return requested();
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file shutdown_signals.hpp
+ * Deliver SIGINT and SIGTERM through a signalfd instead of an asynchronous
+ * signal handler. The signals are blocked in every thread and read from the
+ * event loop, so a shutdown request is an ordinary event that the loop
+ * handles between batches: it can then drain, flush and save its state.
+ ******************************************************************************/
+
+#ifndef __SHUTDOWN_SIGNALS_HPP__
+#define __SHUTDOWN_SIGNALS_HPP__
+
+#include "reactor.hpp"
+
+class ShutdownSignals {
+  private:
+    int signal_fd;
+    //Number of shutdown signals received
+    int received;
+
+    ShutdownSignals(const ShutdownSignals&) = delete;
+    ShutdownSignals& operator=(const ShutdownSignals&) = delete;
+
+  public:
+    /**
+     * Block SIGINT and SIGTERM and open a signalfd for them. Construct this
+     * before any other thread is started so that the threads inherit the
+     * blocked mask and the signals can only arrive through the signalfd.
+     * Throws std::runtime_error if the signalfd cannot be created.
+     */
+    ShutdownSignals();
+    ~ShutdownSignals();
+
+    ///Read shutdown requests from the event loop.
+    void watch(Reactor& reactor);
+
+    /**
+     * Read any pending signals without blocking. A second signal after the
+     * first exits the program immediately, as an escape from a stuck drain.
+     * @return true once shutdown has been requested.
+     */
+    bool check();
+
+    ///True once shutdown has been requested.
+    bool requested() const { return 0 < received; }
+};
+
+#endif //__SHUTDOWN_SIGNALS_HPP__
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "state_kernels.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BSS_X86_KERNELS
+#endif
+
+namespace {
+  //Merge words [begin, end) one 64 bit word at a time.
+  size_t mergeScalar(uint64_t* state, uint64_t* known, uint64_t* dirty,
+                     uint64_t* incoming, uint64_t* touched, size_t begin, size_t end) {
+    size_t changed = 0;
+    for (size_t i = begin; i < end; ++i) {
+      uint64_t t = touched[i];
+      uint64_t in = incoming[i];
+      uint64_t change = t & ((in ^ state[i]) | ~known[i]);
+      state[i] = (state[i] & ~t) | in;
+      known[i] |= t;
+      dirty[i] |= change;
+      incoming[i] = 0;
+      touched[i] = 0;
+      changed += __builtin_popcountll(change);
+    }
+    return changed;
+  }
+
+#ifdef BSS_X86_KERNELS
+#ifdef __SSE2__
+  size_t mergeSSE2(uint64_t* state, uint64_t* known, uint64_t* dirty,
+                   uint64_t* incoming, uint64_t* touched, size_t words) {
+    const __m128i ones = _mm_set1_epi32(-1);
+    const __m128i zero = _mm_setzero_si128();
+    size_t changed = 0;
+    size_t i = 0;
+    for (; i + 2 <= words; i += 2) {
+      __m128i s = _mm_loadu_si128((const __m128i*)(state + i));
+      __m128i k = _mm_loadu_si128((const __m128i*)(known + i));
+      __m128i d = _mm_loadu_si128((const __m128i*)(dirty + i));
+      __m128i in = _mm_loadu_si128((const __m128i*)(incoming + i));
+      __m128i t = _mm_loadu_si128((const __m128i*)(touched + i));
+      __m128i change = _mm_and_si128(t, _mm_or_si128(_mm_xor_si128(in, s), _mm_andnot_si128(k, ones)));
+      _mm_storeu_si128((__m128i*)(state + i), _mm_or_si128(_mm_andnot_si128(t, s), in));
+      _mm_storeu_si128((__m128i*)(known + i), _mm_or_si128(k, t));
+      _mm_storeu_si128((__m128i*)(dirty + i), _mm_or_si128(d, change));
+      _mm_storeu_si128((__m128i*)(incoming + i), zero);
+      _mm_storeu_si128((__m128i*)(touched + i), zero);
+      uint64_t lanes[2];
+      _mm_storeu_si128((__m128i*)lanes, change);
+      changed += __builtin_popcountll(lanes[0]) + __builtin_popcountll(lanes[1]);
+    }
+    return changed + mergeScalar(state, known, dirty, incoming, touched, i, words);
+  }
+#endif
+
+  __attribute__((target("avx2")))
+  size_t mergeAVX2(uint64_t* state, uint64_t* known, uint64_t* dirty,
+                   uint64_t* incoming, uint64_t* touched, size_t words) {
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t changed = 0;
+    size_t i = 0;
+    for (; i + 4 <= words; i += 4) {
+      __m256i s = _mm256_loadu_si256((const __m256i*)(state + i));
+      __m256i k = _mm256_loadu_si256((const __m256i*)(known + i));
+      __m256i d = _mm256_loadu_si256((const __m256i*)(dirty + i));
+      __m256i in = _mm256_loadu_si256((const __m256i*)(incoming + i));
+      __m256i t = _mm256_loadu_si256((const __m256i*)(touched + i));
+      __m256i change = _mm256_and_si256(t, _mm256_or_si256(_mm256_xor_si256(in, s), _mm256_andnot_si256(k, ones)));
+      _mm256_storeu_si256((__m256i*)(state + i), _mm256_or_si256(_mm256_andnot_si256(t, s), in));
+      _mm256_storeu_si256((__m256i*)(known + i), _mm256_or_si256(k, t));
+      _mm256_storeu_si256((__m256i*)(dirty + i), _mm256_or_si256(d, change));
+      _mm256_storeu_si256((__m256i*)(incoming + i), zero);
+      _mm256_storeu_si256((__m256i*)(touched + i), zero);
+      //Most bursts only change a few sensors, so skip the popcount if nothing changed
+      if (not _mm256_testz_si256(change, change)) {
+        uint64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, change);
+        changed += __builtin_popcountll(lanes[0]) + __builtin_popcountll(lanes[1]) +
+                   __builtin_popcountll(lanes[2]) + __builtin_popcountll(lanes[3]);
+      }
+    }
+    return changed + mergeScalar(state, known, dirty, incoming, touched, i, words);
+  }
+#endif
+
+  typedef size_t (*MergeFn)(uint64_t*, uint64_t*, uint64_t*, uint64_t*, uint64_t*, size_t);
+
+  size_t mergePortable(uint64_t* state, uint64_t* known, uint64_t* dirty,
+                       uint64_t* incoming, uint64_t* touched, size_t words) {
+    return mergeScalar(state, known, dirty, incoming, touched, 0, words);
+  }
+
+  struct Kernel {
+    MergeFn merge;
+    const char* name;
+  };
+
+  Kernel chooseKernel() {
+#ifdef BSS_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return Kernel{mergeAVX2, "avx2"};
+    }
+#ifdef __SSE2__
+    return Kernel{mergeSSE2, "sse2"};
+#endif
+#endif
+    return Kernel{mergePortable, "scalar"};
+  }
+
+  const Kernel& kernel() {
+    static const Kernel chosen = chooseKernel();
+    return chosen;
+  }
+}
+
+size_t state_kernels::mergeBatch(uint64_t* state, uint64_t* known, uint64_t* dirty,
+                                 uint64_t* incoming, uint64_t* touched, size_t words) {
+  return kernel().merge(state, known, dirty, incoming, touched, words);
+}
+
+const char* state_kernels::kernelName() {
+  return kernel().name;
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file state_kernels.hpp
+ * Word-parallel kernels that merge a batch of incoming sensor bits into the
+ * state bitsets of a StateStore. The AVX2 version is chosen at run time if
+ * the processor supports it, otherwise SSE2 or plain 64 bit words are used.
+ ******************************************************************************/
+
+#ifndef __STATE_KERNELS_HPP__
+#define __STATE_KERNELS_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace state_kernels {
+  /**
+   * For every word in [0, words):
+   *   change   = touched & ((incoming ^ state) | ~known)
+   *   state    = (state & ~touched) | incoming
+   *   known   |= touched
+   *   dirty   |= change
+   * incoming and touched are cleared afterwards so they can be reused for
+   * the next batch. incoming must be a subset of touched.
+   * @return The number of bits set in the change mask.
+   */
+  size_t mergeBatch(uint64_t* state, uint64_t* known, uint64_t* dirty,
+                    uint64_t* incoming, uint64_t* touched, size_t words);
+
+  ///The name of the kernel that mergeBatch dispatches to.
+  const char* kernelName();
+}
+
+#endif //__STATE_KERNELS_HPP__
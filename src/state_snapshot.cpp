@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "state_snapshot.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "transition_journal.hpp"
+#include "utf8.hpp"
+
+namespace {
+  //Format: the magic, the journal position, a record count, then per record
+  //a value byte and the transmitter, URI and solution as length prefixed
+  //UTF-16 strings.
+  const std::string magic = "BSSSNAP2";
+
+  void putU32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void putU64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+
+  void putString(std::string& out, const std::string& str) {
+    std::u16string units = utf8::decode(str);
+    putU32(out, units.size());
+    out.append(reinterpret_cast<const char*>(units.data()), units.size() * sizeof(char16_t));
+  }
+
+  class Reader {
+    private:
+      const std::string& in;
+      size_t pos;
+
+      void need(size_t bytes) {
+        if (in.size() - pos < bytes) {
+          throw std::runtime_error("Truncated state snapshot");
+        }
+      }
+
+    public:
+      Reader(const std::string& in, size_t pos) : in(in), pos(pos) {}
+
+      uint8_t getU8() {
+        need(1);
+        return in[pos++];
+      }
+
+      uint32_t getU32() {
+        uint32_t value;
+        need(sizeof(value));
+        memcpy(&value, in.data() + pos, sizeof(value));
+        pos += sizeof(value);
+        return value;
+      }
+
+      uint64_t getU64() {
+        uint64_t value;
+        need(sizeof(value));
+        memcpy(&value, in.data() + pos, sizeof(value));
+        pos += sizeof(value);
+        return value;
+      }
+
+      std::string getString() {
+        size_t length = getU32();
+        need(length * sizeof(char16_t));
+        std::u16string units(length, u'\0');
+        memcpy(&units[0], in.data() + pos, length * sizeof(char16_t));
+        pos += length * sizeof(char16_t);
+        return utf8::encode(units);
+      }
+  };
+
+  std::string errorString(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + strerror(errno);
+  }
+}
+
+bool StateSnapshot::load(const std::string& path) {
+  std::ifstream file(path.c_str(), std::ios::binary);
+  if (not file) {
+    if (ENOENT == errno) {
+      return false;
+    }
+    throw std::runtime_error(errorString("Could not open state snapshot", path));
+  }
+  std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (0 != contents.compare(0, magic.size(), magic)) {
+    throw std::runtime_error("Not a state snapshot: " + path);
+  }
+  //Read into a new map so that a truncated file leaves nothing half loaded
+  Reader in(contents, magic.size());
+  uint64_t file_position = in.getU64();
+  uint32_t count = in.getU32();
+  std::map<std::string, Saved> file_saved;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint8_t value = in.getU8();
+    std::string tx = in.getString();
+    Saved& entry = file_saved[tx];
+    entry.uri = in.getString();
+    entry.solution = in.getString();
+    entry.value = value;
+  }
+  saved.swap(file_saved);
+  position = file_position;
+  return true;
+}
+
+bool StateSnapshot::restore(const SensorTable& sensors, size_t slot, StateStore& states) {
+  auto I = saved.find(sensors.transmitter(slot));
+  if (saved.end() == I) {
+    return false;
+  }
+  bool matches = I->second.uri == sensors.uri(slot) and I->second.solution == sensors.solution(slot);
+  if (matches) {
+    states.restore(slot, I->second.value);
+  }
+  saved.erase(I);
+  return matches;
+}
+
+size_t StateSnapshot::rollForward(const std::string& journal_directory) {
+  if (0 == position) {
+    return 0;
+  }
+  //Journal records name the object and solution, not the transmitter
+  std::unordered_map<std::string, std::vector<Saved*>> by_name;
+  for (auto& entry : saved) {
+    by_name[entry.second.uri + '\0' + entry.second.solution].push_back(&entry.second);
+  }
+  size_t applied = 0;
+  TransitionJournal::scan(journal_directory, position, [&](const TransitionJournal::Transition& t) {
+      auto I = by_name.find(t.uri + '\0' + t.solution);
+      if (by_name.end() != I) {
+        for (Saved* entry : I->second) {
+          entry->value = t.value;
+        }
+        ++applied;
+      }
+      position = t.sequence + 1;
+    });
+  return applied;
+}
+
+size_t StateSnapshot::write(const std::string& path, const SensorTable& sensors, const StateStore& states,
+                            uint64_t position) {
+  std::string out = magic;
+  putU64(out, position);
+  size_t count_at = out.size();
+  putU32(out, 0);
+  uint32_t count = 0;
+  for (size_t slot = 0; slot < sensors.capacity(); ++slot) {
+    //Unpublished changes are left out so that they are sent after a restart
+    if (not sensors.inUse(slot) or not states.isKnown(slot) or states.isDirty(slot)) {
+      continue;
+    }
+    out.push_back(states.value(slot));
+    putString(out, sensors.transmitter(slot));
+    putString(out, sensors.uri(slot));
+    putString(out, sensors.solution(slot));
+    ++count;
+  }
+  memcpy(&out[count_at], &count, sizeof(count));
+
+  std::string temp = path + ".tmp";
+  int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (0 > fd) {
+    throw std::runtime_error(errorString("Could not create state snapshot", temp));
+  }
+  size_t written = 0;
+  while (written < out.size()) {
+    ssize_t ret = ::write(fd, out.data() + written, out.size() - written);
+    if (0 > ret and EINTR != errno) {
+      std::string err = errorString("Could not write state snapshot", temp);
+      close(fd);
+      throw std::runtime_error(err);
+    }
+    written += std::max<ssize_t>(ret, 0);
+  }
+  if (0 != fsync(fd)) {
+    std::string err = errorString("Could not sync state snapshot", temp);
+    close(fd);
+    throw std::runtime_error(err);
+  }
+  close(fd);
+  if (0 != rename(temp.c_str(), path.c_str())) {
+    throw std::runtime_error(errorString("Could not replace state snapshot", path));
+  }
+  return count;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file state_snapshot.hpp
+ * Save the published state of every sensor when the solver shuts down and
+ * restore it when the solver starts again. With a snapshot a restart does
+ * not republish states the world model already has, and a sensor that
+ * changed while the solver was down is still seen as a transition.
+ *
+ * Only states that were published are saved. A sensor whose change could
+ * not be sent before shutdown is left out and is published again after the
+ * restart, so that no transition is lost.
+ *
+ * A snapshot records the journal position it was taken at. After a crash
+ * the snapshot from the last clean shutdown is brought up to date with the
+ * transitions journaled since then.
+ ******************************************************************************/
+
+#ifndef __STATE_SNAPSHOT_HPP__
+#define __STATE_SNAPSHOT_HPP__
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include "sensor_table.hpp"
+#include "state_store.hpp"
+
+class StateSnapshot {
+  private:
+    struct Saved {
+      std::string uri;
+      std::string solution;
+      uint8_t value;
+    };
+    //Saved states by transmitter, removed once restored
+    std::map<std::string, Saved> saved;
+    uint64_t position;
+
+  public:
+    StateSnapshot() : position(0) {}
+
+    /**
+     * Read a snapshot file.
+     * @return false if the file does not exist.
+     * Throws std::runtime_error if the file cannot be read or is corrupt.
+     */
+    bool load(const std::string& path);
+
+    /**
+     * Restore the saved state of a newly mapped slot if the transmitter was
+     * saved with the same object and solution.
+     * @return true if a state was restored.
+     */
+    bool restore(const SensorTable& sensors, size_t slot, StateStore& states);
+
+    ///Number of saved states that were not restored yet.
+    size_t size() const { return saved.size(); }
+
+    /**
+     * Apply the transitions journaled after the snapshot was taken.
+     * @return The number of journaled transitions applied.
+     * Throws std::runtime_error if the journal cannot be read.
+     */
+    size_t rollForward(const std::string& journal_directory);
+
+    /**
+     * Save every known, published state. The snapshot is written to a
+     * temporary file, synced and renamed over the old one, so a crash while
+     * saving leaves the previous snapshot intact.
+     * @param position The sequence number of the next journaled transition,
+     *                 or 0 without a journal.
+     * Throws std::runtime_error if the snapshot cannot be written.
+     * @return The number of states saved.
+     */
+    static size_t write(const std::string& path, const SensorTable& sensors, const StateStore& states,
+                        uint64_t position);
+};
+
+#endif //__STATE_SNAPSHOT_HPP__
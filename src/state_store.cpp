@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "state_store.hpp"
+#include "state_kernels.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+StateStore::StateStore() : num_slots(0), value_bits(0) {
+}
+
+void StateStore::setValueBits(int bits) {
+  if (2 != bits and 4 != bits) {
+    throw std::invalid_argument("Sensor values must be 2 or 4 bits wide");
+  }
+  value_bits = bits;
+  fields.assign(num_slots * value_bits / 64, 0);
+}
+
+void StateStore::resize(size_t slots) {
+  if (slots <= num_slots) {
+    return;
+  }
+  size_t words = (slots + 63) / 64;
+  state.resize(words, 0);
+  known.resize(words, 0);
+  dirty.resize(words, 0);
+  incoming.resize(words, 0);
+  touched.resize(words, 0);
+  fields.resize(words * value_bits, 0);
+  num_slots = words * 64;
+}
+
+bool StateStore::update(size_t slot, uint8_t value) {
+  size_t w = word(slot);
+  uint64_t b = bit(slot);
+  bool changed = not (known[w] & b) or (this->value(slot) != value);
+  if (changed) {
+    if (0 < value_bits) {
+      setField(slot, value);
+    }
+    known[w] |= b;
+    if (value) {
+      state[w] |= b;
+    }
+    else {
+      state[w] &= ~b;
+    }
+    dirty[w] |= b;
+  }
+  return changed;
+}
+
+size_t StateStore::applyBatch(const std::vector<uint32_t>& slots, const std::vector<uint8_t>& values) {
+  if (slots.empty()) {
+    return 0;
+  }
+  //Store the values of multi state sensors first, latest value of each slot
+  //only. A change between two values that have the same bit is invisible
+  //to the kernel, so such slots are marked dirty here.
+  size_t moved = 0;
+  if (0 < value_bits) {
+    for (size_t i = slots.size(); i-- > 0;) {
+      size_t w = word(slots[i]);
+      uint64_t b = bit(slots[i]);
+      if (touched[w] & b) {
+        continue;
+      }
+      touched[w] |= b;
+      if (field(slots[i]) != values[i]) {
+        setField(slots[i], values[i]);
+        if ((known[w] & b) and (0 != (state[w] & b)) == (0 != values[i])) {
+          dirty[w] |= b;
+          ++moved;
+        }
+      }
+    }
+  }
+  //Gather the new bits and remember the words that they touch
+  batch_words.clear();
+  for (size_t i = 0; i < slots.size(); ++i) {
+    size_t w = word(slots[i]);
+    uint64_t b = bit(slots[i]);
+    touched[w] |= b;
+    incoming[w] = values[i] ? (incoming[w] | b) : (incoming[w] & ~b);
+    batch_words.push_back(w);
+  }
+  std::sort(batch_words.begin(), batch_words.end());
+  //Merge runs of nearby words, joining short gaps of untouched words,
+  //which the kernel leaves alone, rather than calling it for every word
+  const size_t max_gap = 8;
+  size_t changed = moved;
+  size_t first = batch_words[0];
+  size_t last = first;
+  for (size_t w : batch_words) {
+    if (w > last + max_gap) {
+      changed += state_kernels::mergeBatch(&state[first], &known[first], &dirty[first],
+                                           &incoming[first], &touched[first], last - first + 1);
+      first = w;
+    }
+    last = w;
+  }
+  return changed + state_kernels::mergeBatch(&state[first], &known[first], &dirty[first],
+                                             &incoming[first], &touched[first], last - first + 1);
+}
+
+void StateStore::forget(size_t slot) {
+  size_t w = word(slot);
+  uint64_t b = bit(slot);
+  state[w] &= ~b;
+  known[w] &= ~b;
+  dirty[w] &= ~b;
+  if (0 < value_bits) {
+    setField(slot, 0);
+  }
+}
+
+void StateStore::restore(size_t slot, uint8_t value) {
+  size_t w = word(slot);
+  uint64_t b = bit(slot);
+  known[w] |= b;
+  if (0 < value_bits) {
+    setField(slot, value);
+  }
+  if (value) {
+    state[w] |= b;
+  }
+  else {
+    state[w] &= ~b;
+  }
+  dirty[w] &= ~b;
+}
+
+size_t StateStore::markKnownDirty() {
+  size_t total = 0;
+  for (size_t w = 0; w < dirty.size(); ++w) {
+    dirty[w] |= known[w];
+    total += __builtin_popcountll(known[w]);
+  }
+  return total;
+}
+
+size_t StateStore::dirtyCount() const {
+  size_t total = 0;
+  for (uint64_t bits : dirty) {
+    total += __builtin_popcountll(bits);
+  }
+  return total;
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file state_store.hpp
+ * Dense storage of binary sensor states, one bit per sensor slot.
+ * A parallel dirty bitmap records which slots changed since the last
+ * publish so that only those sensors need to be sent to the world model.
+ *
+ * Sensors with more than two states, such as a coffee pot that is idle,
+ * brewing or ready, keep their value in packed 2 or 4 bit fields next to
+ * the bits. The state bit of such a sensor is set when it is not in its
+ * first state, so everything that only reads the bits sees it as a binary
+ * sensor. Without enumerated solutions no fields are allocated.
+ ******************************************************************************/
+
+#ifndef __STATE_STORE_HPP__
+#define __STATE_STORE_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "huge_pages.hpp"
+
+class StateStore {
+  public:
+    typedef std::vector<uint64_t, huge_pages::Allocator<uint64_t>> Bits;
+
+  private:
+    //One bit per slot for the current state, whether a state has been
+    //observed yet, and whether the slot changed since the last publish.
+    Bits state;
+    Bits known;
+    Bits dirty;
+    size_t num_slots;
+    //Packed values of every slot, value_bits wide, when any slot has more
+    //than two states
+    Bits fields;
+    int value_bits;
+
+    //Scratch bitsets used to gather the new values of a batch of samples
+    //before they are merged into the state in one pass.
+    Bits incoming;
+    Bits touched;
+    //Words touched by the batch, so that only they are merged
+    std::vector<size_t> batch_words;
+
+    static size_t word(size_t slot) { return slot / 64; }
+    static uint64_t bit(size_t slot) { return uint64_t(1) << (slot % 64); }
+
+    uint8_t field(size_t slot) const {
+      size_t at = slot * value_bits;
+      return (fields[at / 64] >> (at % 64)) & ((1 << value_bits) - 1);
+    }
+    void setField(size_t slot, uint8_t value) {
+      size_t at = slot * value_bits;
+      uint64_t mask = uint64_t((1 << value_bits) - 1) << (at % 64);
+      fields[at / 64] = (fields[at / 64] & ~mask) | (uint64_t(value) << (at % 64) & mask);
+    }
+
+  public:
+    StateStore();
+
+    /**
+     * Keep a value of the given width, 2 or 4 bits, for every slot so that
+     * sensors can have up to 4 or 16 states. Call this before the store is
+     * resized.
+     */
+    void setValueBits(int bits);
+
+    ///Width of the stored values in bits, 0 if every sensor is binary.
+    int valueBits() const { return value_bits; }
+
+    ///Grow the store so that it can hold at least the given number of slots.
+    void resize(size_t slots);
+
+    ///Number of slots this store can hold.
+    size_t size() const { return num_slots; }
+
+    ///True if a state has been stored for this slot.
+    bool isKnown(size_t slot) const { return known[word(slot)] & bit(slot); }
+
+    ///The current state of a slot. Only meaningful if isKnown(slot).
+    bool get(size_t slot) const { return state[word(slot)] & bit(slot); }
+
+    ///The current value of a slot, 0 or 1 for binary sensors. Only meaningful if isKnown(slot).
+    uint8_t value(size_t slot) const { return 0 < value_bits ? field(slot) : get(slot); }
+
+    ///True if the slot is waiting to be published.
+    bool isDirty(size_t slot) const { return dirty[word(slot)] & bit(slot); }
+
+    /**
+     * Store a new value for a slot. If the value differs from the stored one,
+     * or no value was stored before, the slot is marked dirty.
+     * @return true if the slot was marked dirty.
+     */
+    bool update(size_t slot, uint8_t value);
+
+    /**
+     * Store new values for a batch of slots. The values are first gathered
+     * into a bitvector and then merged into the stored state with a
+     * vectorized kernel that produces the change mask of the whole batch.
+     * Only the runs of words that the batch touches are merged, so a small
+     * batch of scattered slots costs no more than the slots themselves.
+     * If a slot appears more than once the last value wins. Values above 1
+     * are compared field by field before the bits are merged.
+     * @return The number of slots that were marked dirty.
+     */
+    size_t applyBatch(const std::vector<uint32_t>& slots, const std::vector<uint8_t>& values);
+
+    ///Mark a slot as needing to be published again.
+    void markDirty(size_t slot) { dirty[word(slot)] |= bit(slot); }
+
+    ///Forget the state of a slot, for instance when its sensor is removed.
+    void forget(size_t slot);
+
+    /**
+     * Store a value that the world model already has, such as a state saved
+     * before a restart. The slot becomes known but is not marked dirty.
+     */
+    void restore(size_t slot, uint8_t value);
+
+    /**
+     * Mark every known slot as needing to be published again.
+     * @return The number of slots marked.
+     */
+    size_t markKnownDirty();
+
+    ///Number of slots waiting to be published.
+    size_t dirtyCount() const;
+
+    /**
+     * Call f(slot, value) for every dirty slot in increasing slot order and
+     * clear the dirty bits. Whole words of clean slots are skipped and the
+     * set bits inside a word are visited with count-trailing-zeros.
+     */
+    template<typename F>
+    void drainDirty(F f) {
+      for (size_t w = 0; w < dirty.size(); ++w) {
+        uint64_t bits = dirty[w];
+        if (0 == bits) {
+          continue;
+        }
+        dirty[w] = 0;
+        while (bits) {
+          size_t slot = w * 64 + __builtin_ctzll(bits);
+          f(slot, get(slot));
+          //Clear the lowest set bit
+          bits &= bits - 1;
+        }
+      }
+    }
+};
+
+#endif //__STATE_STORE_HPP__
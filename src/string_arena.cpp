@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "string_arena.hpp"
+
+#include <stdexcept>
+
+StringArena::StringArena() : bytes(unit, 0), live_bytes(0), free_bytes(0) {
+  //The first unit is never handed out so that no_ref stays invalid
+}
+
+void StringArena::reserve(size_t string_bytes) {
+  bytes.reserve(bytes.size() + string_bytes);
+}
+
+StringArena::Ref StringArena::add(const char* data, size_t size) {
+  size_t units = unitsFor(size);
+  Ref ref;
+  if (units < free_records.size() and not free_records[units].empty()) {
+    ref = free_records[units].back();
+    free_records[units].pop_back();
+    free_bytes -= units * unit;
+  }
+  else {
+    if (UINT32_MAX - bytes.size() < units * unit) {
+      throw std::runtime_error("The string arena is full");
+    }
+    ref = bytes.size();
+    bytes.resize(bytes.size() + units * unit);
+  }
+  uint32_t length = size;
+  memcpy(&bytes[ref], &length, sizeof(length));
+  memcpy(&bytes[ref + sizeof(length)], data, size);
+  live_bytes += units * unit;
+  return ref;
+}
+
+void StringArena::release(Ref ref) {
+  if (no_ref == ref) {
+    return;
+  }
+  size_t units = unitsFor(size(ref));
+  if (free_records.size() <= units) {
+    free_records.resize(units + 1);
+  }
+  free_records[units].push_back(ref);
+  live_bytes -= units * unit;
+  free_bytes += units * unit;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file string_arena.hpp
+ * Compact storage for many small UTF-8 strings such as transmitter names and
+ * object URIs. Each string is a four byte length followed by its bytes in
+ * one shared buffer, and is referred to by its four byte offset, so a name
+ * costs its length plus a few bytes instead of a string object and a heap
+ * allocation of twice its length.
+ *
+ * Released strings are kept on free lists by size and reused by later
+ * strings of the same size, which is the common case when a transmitter is
+ * mapped to another object with a similar URI.
+ ******************************************************************************/
+
+#ifndef __STRING_ARENA_HPP__
+#define __STRING_ARENA_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "huge_pages.hpp"
+
+class StringArena {
+  public:
+    typedef uint32_t Ref;
+    ///Never returned by add, for unused references.
+    static const Ref no_ref = 0;
+
+  private:
+    //Records are padded to a multiple of this many bytes
+    static const size_t unit = sizeof(uint32_t);
+
+    std::vector<char, huge_pages::Allocator<char>> bytes;
+    //Released records, indexed by their size in units
+    std::vector<std::vector<Ref>> free_records;
+    size_t live_bytes;
+    size_t free_bytes;
+
+    static size_t unitsFor(size_t length) { return (sizeof(uint32_t) + length + unit - 1) / unit; }
+
+  public:
+    StringArena();
+
+    ///Make room for about the given number of bytes of strings.
+    void reserve(size_t string_bytes);
+
+    /**
+     * Store a copy of a string.
+     * Throws std::runtime_error if the arena would grow past 4GB.
+     */
+    Ref add(const char* data, size_t size);
+    Ref add(const std::string& str) { return add(str.data(), str.size()); }
+
+    ///Release a string so its space can be reused. no_ref is ignored.
+    void release(Ref ref);
+
+    size_t size(Ref ref) const {
+      uint32_t length;
+      memcpy(&length, &bytes[ref], sizeof(length));
+      return length;
+    }
+
+    const char* data(Ref ref) const { return &bytes[ref + sizeof(uint32_t)]; }
+
+    std::string str(Ref ref) const { return std::string(data(ref), size(ref)); }
+
+    bool equals(Ref ref, const std::string& str) const {
+      return size(ref) == str.size() and 0 == memcmp(data(ref), str.data(), str.size());
+    }
+
+    ///Bytes held by live strings, including their lengths and padding.
+    size_t bytesUsed() const { return live_bytes; }
+
+    ///Bytes of released strings waiting to be reused.
+    size_t bytesFree() const { return free_bytes; }
+};
+
+#endif //__STRING_ARENA_HPP__
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "thread_placement.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <sched.h>
+
+const std::string ThreadPlacement::ingest = "ingest";
+
+std::vector<int> ThreadPlacement::parseCpus(const std::string& list) {
+  std::vector<int> cpus;
+  std::istringstream in(list);
+  std::string range;
+  while (std::getline(in, range, ',')) {
+    size_t dash = range.find('-');
+    try {
+      size_t first_end = 0;
+      size_t last_end = 0;
+      int first = std::stoi(range.substr(0, dash), &first_end);
+      int last = (std::string::npos == dash) ? first : std::stoi(range.substr(dash + 1), &last_end);
+      bool whole = first_end == std::min(dash, range.size()) and
+                   (std::string::npos == dash or last_end == range.size() - dash - 1);
+      if (not whole or first < 0 or last < first or last >= CPU_SETSIZE) {
+        throw std::out_of_range(range);
+      }
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    catch (std::exception& err) {
+      throw std::invalid_argument("Bad cpu list '" + list + "'");
+    }
+  }
+  return cpus;
+}
+
+ThreadPlacement::ThreadPlacement(const Options& options) {
+  CPU_ZERO(&process_cpus);
+  if (0 != sched_getaffinity(0, sizeof(process_cpus), &process_cpus)) {
+    CPU_ZERO(&process_cpus);
+  }
+  for (auto& pin : options.withPrefix("pin-")) {
+    roles[pin.first].cpus = parseCpus(pin.second);
+  }
+  for (auto& fifo : options.withPrefix("fifo-")) {
+    try {
+      size_t end = 0;
+      int priority = std::stoi(fifo.second, &end);
+      if (fifo.second.size() != end or priority < sched_get_priority_min(SCHED_FIFO) or
+          priority > sched_get_priority_max(SCHED_FIFO)) {
+        throw std::out_of_range(fifo.second);
+      }
+      roles[fifo.first].fifo_priority = priority;
+    }
+    catch (std::exception& err) {
+      throw std::invalid_argument("Bad SCHED_FIFO priority '" + fifo.second + "' for " + fifo.first);
+    }
+  }
+}
+
+void ThreadPlacement::apply(const std::string& role) const {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  bool pin = false;
+  int fifo_priority = 0;
+
+  auto I = roles.find(role);
+  if (roles.end() != I and not I->second.cpus.empty()) {
+    for (int cpu : I->second.cpus) {
+      CPU_SET(cpu, &cpus);
+    }
+    pin = true;
+  }
+  else if (0 < CPU_COUNT(&process_cpus)) {
+    //Start from the cpus of the process rather than the ones inherited from
+    //the thread that started this one, which may be the pinned ingest thread
+    cpus = process_cpus;
+    //Keep unplaced roles away from the ingest cores
+    auto ingest_role = roles.find(ingest);
+    if (role != ingest and roles.end() != ingest_role) {
+      for (int cpu : ingest_role->second.cpus) {
+        CPU_CLR(cpu, &cpus);
+      }
+      if (0 == CPU_COUNT(&cpus)) {
+        cpus = process_cpus;
+      }
+    }
+    pin = true;
+  }
+  if (roles.end() != I) {
+    fifo_priority = I->second.fifo_priority;
+  }
+
+  if (pin) {
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    if (0 != err) {
+      std::cerr<<"Could not pin the "<<role<<" thread: "<<strerror(err)<<'\n';
+    }
+  }
+  if (0 < fifo_priority) {
+    sched_param param;
+    param.sched_priority = fifo_priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (0 != err) {
+      std::cerr<<"Could not give the "<<role<<" thread SCHED_FIFO priority "<<
+        fifo_priority<<": "<<strerror(err)<<'\n';
+    }
+  }
+  else {
+    //Do not keep a SCHED_FIFO priority inherited from the starting thread
+    sched_param param;
+    param.sched_priority = 0;
+    int err = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    if (0 != err) {
+      std::cerr<<"Could not reset the scheduler of the "<<role<<" thread: "<<strerror(err)<<'\n';
+    }
+  }
+}
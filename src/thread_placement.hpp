@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file thread_placement.hpp
+ * Pin the solver's threads to cores by role and optionally run them with
+ * SCHED_FIFO priority. Roles are configured with --pin-<role>=<cpu list>
+ * (for instance --pin-ingest=2 or --pin-sender=4-5,7) and
+ * --fifo-<role>=<priority>. When the ingest thread is pinned, every role
+ * without its own placement is kept off the ingest cores so that
+ * bookkeeping work cannot disturb it. Threads inherit the placement of the
+ * thread that starts them, so every role is placed from the cpus the
+ * process had at startup and roles without a priority of their own run
+ * with the normal scheduler.
+ ******************************************************************************/
+
+#ifndef __THREAD_PLACEMENT_HPP__
+#define __THREAD_PLACEMENT_HPP__
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sched.h>
+
+#include "options.hpp"
+
+class ThreadPlacement {
+  public:
+    ///The latency critical role that the other roles are isolated from.
+    static const std::string ingest;
+
+  private:
+    struct Placement {
+      std::vector<int> cpus;
+      //Zero for the normal scheduler
+      int fifo_priority;
+    };
+    std::map<std::string, Placement> roles;
+    //The cpus the process could run on before any thread was placed
+    cpu_set_t process_cpus;
+
+    ///Parse a list such as "1,3-5" into cpu numbers.
+    static std::vector<int> parseCpus(const std::string& list);
+
+  public:
+    /**
+     * Read the placement of each role from the options and remember the
+     * cpus of the process. Construct this before placing any thread.
+     * Throws std::invalid_argument for malformed cpu lists or priorities
+     * outside the SCHED_FIFO range.
+     */
+    ThreadPlacement(const Options& options);
+
+    /**
+     * Place the calling thread according to its role. Problems, such as
+     * missing permission for SCHED_FIFO, are reported but not fatal.
+     */
+    void apply(const std::string& role) const;
+};
+
+#endif //__THREAD_PLACEMENT_HPP__
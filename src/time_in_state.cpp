@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "time_in_state.hpp"
+
+#include <algorithm>
+
+TimeInState::TimeInState(int64_t window_ms) : window_ms(window_ms), drained_window(0) {
+}
+
+int64_t TimeInState::windowOf(int64_t time) const {
+  int64_t offset = time % window_ms;
+  return time - (offset < 0 ? offset + window_ms : offset);
+}
+
+void TimeInState::roll(Accumulator& acc, int64_t time) {
+  int64_t window = windowOf(time);
+  if (window > acc.window_start) {
+    acc.window_start = window;
+    acc.true_ms = 0;
+    acc.false_ms = 0;
+    acc.transitions = 0;
+  }
+}
+
+void TimeInState::queue(size_t slot) {
+  if (not accumulators[slot].queued) {
+    accumulators[slot].queued = true;
+    changed.push_back(slot);
+  }
+}
+
+void TimeInState::resize(size_t slots) {
+  if (accumulators.size() < slots) {
+    accumulators.resize(slots, Accumulator{0, 0, 0, 0, 0, false, false, false});
+  }
+}
+
+void TimeInState::transition(size_t slot, bool value, int64_t time) {
+  Accumulator& acc = accumulators[slot];
+  if (acc.known) {
+    if (acc.value == value) {
+      return;
+    }
+    roll(acc, time);
+    //Samples can arrive slightly out of order, so never count negative time
+    int64_t spent = time - std::max(acc.since, acc.window_start);
+    if (0 < spent) {
+      (acc.value ? acc.true_ms : acc.false_ms) += spent;
+    }
+    ++acc.transitions;
+  }
+  else {
+    acc.window_start = windowOf(time);
+    acc.true_ms = 0;
+    acc.false_ms = 0;
+    acc.transitions = 0;
+    acc.known = true;
+  }
+  acc.value = value;
+  acc.since = time;
+  queue(slot);
+}
+
+void TimeInState::forget(size_t slot) {
+  if (slot < accumulators.size()) {
+    //A queued slot stays in the changed list and is skipped when drained
+    accumulators[slot].known = false;
+  }
+}
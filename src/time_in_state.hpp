@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file time_in_state.hpp
+ * Per-sensor accumulators of how long each sensor spent in each state and
+ * how many transitions it made, so that questions such as "how long was
+ * this door open today" do not need the sensor's history.
+ *
+ * Totals are kept per window. Windows are aligned to multiples of the
+ * window length since the epoch, so with the default of one day they are
+ * UTC days. Every transition updates its sensor in constant time; the
+ * sensors that changed are published together at a fixed cadence, and
+ * every sensor is published once more when a new window starts.
+ ******************************************************************************/
+
+#ifndef __TIME_IN_STATE_HPP__
+#define __TIME_IN_STATE_HPP__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "huge_pages.hpp"
+
+class TimeInState {
+  public:
+    ///The accumulated values of one sensor.
+    struct Totals {
+      ///The current state and the time it was entered.
+      bool value;
+      int64_t since;
+      ///Start of the current window.
+      int64_t window_start;
+      ///Time spent in each state during the window.
+      int64_t true_ms;
+      int64_t false_ms;
+      ///Transitions during the window.
+      uint32_t transitions;
+    };
+
+  private:
+    struct Accumulator {
+      int64_t since;
+      int64_t window_start;
+      //Time in each state during the window before the current state began
+      int64_t true_ms;
+      int64_t false_ms;
+      uint32_t transitions;
+      bool known;
+      bool value;
+      //True while the slot is waiting in the changed list
+      bool queued;
+    };
+
+    int64_t window_ms;
+    std::vector<Accumulator, huge_pages::Allocator<Accumulator>> accumulators;
+    std::vector<size_t> changed;
+    //Window of the last drain, to notice when a new one starts
+    int64_t drained_window;
+
+    int64_t windowOf(int64_t time) const;
+    ///Start a new window for the accumulator if time is past its window.
+    void roll(Accumulator& acc, int64_t time);
+    void queue(size_t slot);
+
+  public:
+    ///@param window_ms The length of the accumulation windows.
+    TimeInState(int64_t window_ms);
+
+    ///Make room for at least the given number of sensor slots.
+    void resize(size_t slots);
+
+    /**
+     * Record that a sensor entered a state at the given time. The first
+     * state of a sensor only starts its accounting and is not counted as
+     * a transition.
+     */
+    void transition(size_t slot, bool value, int64_t time);
+
+    ///Forget a sensor, for instance when its slot is given to another one.
+    void forget(size_t slot);
+
+    ///Number of sensors waiting to be published.
+    size_t pending() const { return changed.size(); }
+
+    /**
+     * Call f(slot, totals) with the totals as of now for every sensor that
+     * changed since the last drain, or for every known sensor if a new
+     * window started since then.
+     */
+    template<typename F>
+    void drain(int64_t now, F f) {
+      int64_t window = windowOf(now);
+      if (window != drained_window) {
+        drained_window = window;
+        for (size_t slot = 0; slot < accumulators.size(); ++slot) {
+          if (accumulators[slot].known) {
+            queue(slot);
+          }
+        }
+      }
+      for (size_t slot : changed) {
+        Accumulator& acc = accumulators[slot];
+        acc.queued = false;
+        if (not acc.known) {
+          continue;
+        }
+        roll(acc, now);
+        Totals totals{acc.value, acc.since, acc.window_start, acc.true_ms, acc.false_ms, acc.transitions};
+        //Add the time spent in the current state so far
+        int64_t current = now - std::max(acc.since, acc.window_start);
+        if (0 < current) {
+          (acc.value ? totals.true_ms : totals.false_ms) += current;
+        }
+        f(slot, totals);
+      }
+      changed.clear();
+    }
+};
+
+#endif //__TIME_IN_STATE_HPP__
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "token_bucket.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+TokenBucket::TokenBucket(double rate, double burst) :
+  rate(rate), burst(std::max(burst, 1.0)), tokens(this->burst), last_us(-1), num_taken(0), num_limited(0) {
+}
+
+void TokenBucket::refill(int64_t now_us) {
+  if (0 <= last_us and now_us > last_us) {
+    tokens = std::min(burst, tokens + rate * (now_us - last_us) / 1000000.0);
+  }
+  if (now_us > last_us) {
+    last_us = now_us;
+  }
+}
+
+size_t TokenBucket::available() const {
+  if (not enabled()) {
+    return SIZE_MAX;
+  }
+  return 0 < tokens ? size_t(tokens) : 0;
+}
+
+void TokenBucket::take(size_t count) {
+  num_taken += count;
+  if (enabled()) {
+    tokens = std::max(-burst, tokens - double(count));
+  }
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file token_bucket.hpp
+ * A token bucket that limits how many updates per second the solver writes
+ * to the world model. Tokens accrue at a fixed rate up to a burst size and
+ * each update takes one. Updates that must go out regardless, such as
+ * derived attributes, may borrow up to one burst ahead, which the updates
+ * that can wait then pay back.
+ ******************************************************************************/
+
+#ifndef __TOKEN_BUCKET_HPP__
+#define __TOKEN_BUCKET_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+class TokenBucket {
+  private:
+    double rate;
+    double burst;
+    double tokens;
+    //Time of the last refill in microseconds, or -1 before the first
+    int64_t last_us;
+    uint64_t num_taken;
+    uint64_t num_limited;
+
+  public:
+    /**
+     * @param rate Tokens added per second, 0 for no limit.
+     * @param burst Most tokens that can accrue. The bucket starts full.
+     */
+    TokenBucket(double rate, double burst);
+
+    ///True if updates are limited.
+    bool enabled() const { return 0 < rate; }
+
+    ///Add the tokens accrued up to a time in microseconds.
+    void refill(int64_t now_us);
+
+    ///Whole tokens that can be taken now, SIZE_MAX without a limit.
+    size_t available() const;
+
+    /**
+     * Take tokens for updates that were sent. Taking more than are
+     * available borrows, down to one burst below empty.
+     */
+    void take(size_t count);
+
+    ///Record that count updates had to wait for tokens.
+    void limited(size_t count) { num_limited += count; }
+
+    ///Tokens taken and updates that waited for tokens so far.
+    uint64_t taken() const { return num_taken; }
+    uint64_t limitedCount() const { return num_limited; }
+
+    double ratePerSecond() const { return rate; }
+};
+
+#endif //__TOKEN_BUCKET_HPP__
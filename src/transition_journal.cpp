@@ -0,0 +1,484 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "transition_journal.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utf8.hpp"
+
+namespace {
+  const std::string magic = "BSSJRNL1";
+  const std::string suffix = ".journal";
+
+  //Record tags
+  const uint8_t name_record = 0;
+  const uint8_t off_record = 1;
+  const uint8_t on_record = 2;
+  //A transition of a sensor with more than two states, followed by its value
+  const uint8_t value_record = 3;
+
+  std::string errorString(const std::string& what, const std::string& path) {
+    return what + " " + path + ": " + strerror(errno);
+  }
+
+  void putVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+      out.push_back(char(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(char(value));
+  }
+
+  //Zigzag encoding keeps small negative differences small
+  void putSigned(std::string& out, int64_t value) {
+    putVarint(out, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+  }
+
+  //Strings are stored as a length and one varint per UTF-16 unit, so ASCII
+  //names take one byte per character
+  void putString(std::string& out, const std::string& str) {
+    std::u16string units = utf8::decode(str);
+    putVarint(out, units.size());
+    for (char16_t c : units) {
+      putVarint(out, c);
+    }
+  }
+
+  std::string segmentPath(const std::string& directory, uint64_t first_sequence) {
+    char name[32];
+    snprintf(name, sizeof(name), "%020llu", (unsigned long long)first_sequence);
+    return directory + "/" + name + suffix;
+  }
+
+  ///First sequence numbers of the segments in a directory, in order.
+  std::vector<uint64_t> listSegments(const std::string& directory) {
+    std::vector<uint64_t> segments;
+    DIR* dir = opendir(directory.c_str());
+    if (nullptr == dir) {
+      throw std::runtime_error(errorString("Could not open journal directory", directory));
+    }
+    while (dirent* entry = readdir(dir)) {
+      std::string name(entry->d_name);
+      if (name.size() == 20 + suffix.size() and
+          0 == name.compare(20, std::string::npos, suffix) and
+          std::all_of(name.begin(), name.begin() + 20, ::isdigit)) {
+        segments.push_back(std::stoull(name.substr(0, 20)));
+      }
+    }
+    closedir(dir);
+    std::sort(segments.begin(), segments.end());
+    return segments;
+  }
+
+  //Decodes one segment, stopping quietly at a torn record at the end
+  class SegmentReader {
+    private:
+      std::string data;
+      size_t pos;
+      std::vector<std::pair<std::string, std::string>> names;
+
+      bool getVarint(uint64_t& value) {
+        value = 0;
+        for (int shift = 0; shift < 64 and pos < data.size(); shift += 7) {
+          uint8_t byte = data[pos++];
+          value |= uint64_t(byte & 0x7f) << shift;
+          if (0 == (byte & 0x80)) {
+            return true;
+          }
+        }
+        return false;
+      }
+
+      bool getSigned(int64_t& value) {
+        uint64_t raw;
+        if (not getVarint(raw)) {
+          return false;
+        }
+        value = int64_t(raw >> 1) ^ -int64_t(raw & 1);
+        return true;
+      }
+
+      bool getString(std::string& str) {
+        uint64_t length;
+        if (not getVarint(length) or length > data.size() - pos) {
+          return false;
+        }
+        std::u16string units(length, u'\0');
+        for (uint64_t i = 0; i < length; ++i) {
+          uint64_t c;
+          if (not getVarint(c)) {
+            return false;
+          }
+          units[i] = c;
+        }
+        str = utf8::encode(units);
+        return true;
+      }
+
+    public:
+      uint64_t sequence;
+      int64_t last_publish_time;
+
+      /**
+       * @param first_sequence The first sequence number from the segment's
+       *                       name, for a segment whose header is torn.
+       */
+      SegmentReader(const std::string& path, uint64_t first_sequence) :
+        pos(0), sequence(first_sequence), last_publish_time(0) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (not file) {
+          throw std::runtime_error(errorString("Could not open journal segment", path));
+        }
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        //A segment created just before a crash may hold only part of its
+        //header, which leaves it without any records
+        if (data.size() < magic.size() and 0 == magic.compare(0, data.size(), data)) {
+          data.clear();
+          return;
+        }
+        if (0 != data.compare(0, magic.size(), magic)) {
+          throw std::runtime_error("Not a journal segment: " + path);
+        }
+        pos = magic.size();
+        if (not getVarint(sequence)) {
+          sequence = first_sequence;
+          pos = magic.size();
+          data.resize(pos);
+        }
+      }
+
+      ///Offset of the end of the last complete record.
+      size_t validLength() const { return pos; }
+
+      /**
+       * Decode the next transition into t.
+       * @return false at the end of the segment or at a torn record.
+       */
+      bool next(TransitionJournal::Transition& t) {
+        while (pos < data.size()) {
+          size_t start = pos;
+          uint8_t tag = data[pos++];
+          uint64_t id;
+          bool complete = getVarint(id);
+          if (complete and name_record == tag) {
+            std::pair<std::string, std::string> name;
+            if (getString(name.first) and getString(name.second)) {
+              if (names.size() <= id) {
+                names.resize(id + 1);
+              }
+              names[id] = name;
+              continue;
+            }
+          }
+          else if (complete and (off_record == tag or on_record == tag or value_record == tag) and
+                   id < names.size()) {
+            int64_t publish_delta;
+            int64_t sample_delta;
+            uint64_t value = on_record == tag;
+            if (getSigned(publish_delta) and getSigned(sample_delta) and
+                (value_record != tag or getVarint(value))) {
+              t.sequence = sequence++;
+              t.uri = names[id].first;
+              t.solution = names[id].second;
+              t.value = value;
+              t.publish_time = last_publish_time + publish_delta;
+              t.sample_time = t.publish_time - sample_delta;
+              last_publish_time = t.publish_time;
+              return true;
+            }
+          }
+          //A torn or unknown record ends the segment
+          pos = start;
+          return false;
+        }
+        return false;
+      }
+  };
+}
+
+TransitionJournal::TransitionJournal(const Config& config, std::function<void()> on_start) :
+  config(config), next_name(0), next_sequence(1), durable_sequence(1), sync_requested(false),
+  stopping(false), lost(false), segment_fd(-1), segment_size(0), last_publish_time(0), written_sequence(1),
+  on_start(on_start) {
+  if (0 != mkdir(config.directory.c_str(), 0755) and EEXIST != errno) {
+    throw std::runtime_error(errorString("Could not create journal directory", config.directory));
+  }
+  recover();
+  writer = std::thread(&TransitionJournal::run, this);
+}
+
+TransitionJournal::~TransitionJournal() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_one();
+  writer.join();
+  if (0 <= segment_fd) {
+    close(segment_fd);
+  }
+}
+
+void TransitionJournal::recover() {
+  std::vector<uint64_t> segments = listSegments(config.directory);
+  if (segments.empty()) {
+    return;
+  }
+  std::string path = segmentPath(config.directory, segments.back());
+  SegmentReader reader(path, segments.back());
+  Transition t;
+  while (reader.next(t));
+  //Drop a record that was only partly written when the solver stopped
+  if (0 != truncate(path.c_str(), reader.validLength())) {
+    throw std::runtime_error(errorString("Could not truncate journal segment", path));
+  }
+  next_sequence = reader.sequence;
+  durable_sequence = next_sequence;
+  written_sequence = next_sequence;
+}
+
+bool TransitionJournal::rotate() {
+  bool synced_old = true;
+  if (0 <= segment_fd) {
+    if (0 != fdatasync(segment_fd)) {
+      std::cerr<<"Could not sync journal segment: "<<strerror(errno)<<'\n';
+      synced_old = false;
+    }
+    close(segment_fd);
+  }
+  std::string path = segmentPath(config.directory, written_sequence);
+  segment_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  while (0 > segment_fd) {
+    std::cerr<<errorString("Could not create journal segment", path)<<", retrying\n";
+    if (not retryLater()) {
+      return false;
+    }
+    segment_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  }
+  //Make the new file itself durable
+  int dir_fd = open(config.directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (0 <= dir_fd) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+  segment_size = 0;
+  last_publish_time = 0;
+  written_names.assign(names.size(), false);
+  return synced_old;
+}
+
+void TransitionJournal::encode(const Pending& record, std::string& out) {
+  if (written_names.size() <= record.name) {
+    written_names.resize(record.name + 1, false);
+  }
+  if (not written_names[record.name]) {
+    out.push_back(name_record);
+    putVarint(out, record.name);
+    putString(out, names[record.name].first);
+    putString(out, names[record.name].second);
+    written_names[record.name] = true;
+  }
+  out.push_back(1 < record.value ? value_record : record.value ? on_record : off_record);
+  putVarint(out, record.name);
+  putSigned(out, record.publish_time - last_publish_time);
+  putSigned(out, record.publish_time - record.sample_time);
+  if (1 < record.value) {
+    putVarint(out, record.value);
+  }
+  last_publish_time = record.publish_time;
+  ++written_sequence;
+}
+
+bool TransitionJournal::retryLater() {
+  std::unique_lock<std::mutex> lock(mutex);
+  return not wake.wait_for(lock, std::chrono::seconds(1), [this]() { return stopping; });
+}
+
+bool TransitionJournal::writeAll(std::string& out) {
+  size_t written = 0;
+  while (written < out.size()) {
+    ssize_t ret = 0 <= segment_fd ? write(segment_fd, out.data() + written, out.size() - written) : -1;
+    if (0 > ret and EINTR == errno) {
+      continue;
+    }
+    if (0 > ret) {
+      std::cerr<<"Journal write failed: "<<strerror(errno)<<", retrying\n";
+      if (0 > segment_fd or not retryLater()) {
+        std::cerr<<"Journal stopped with "<<out.size() - written<<" bytes unwritten\n";
+        out.clear();
+        return false;
+      }
+      continue;
+    }
+    written += ret;
+  }
+  segment_size += out.size();
+  out.clear();
+  return true;
+}
+
+void TransitionJournal::run() {
+  if (on_start) {
+    on_start();
+  }
+  std::vector<Pending> records;
+  std::vector<std::pair<uint32_t, std::pair<std::string, std::string>>> new_names;
+  std::string out;
+  std::chrono::steady_clock::time_point last_sync = std::chrono::steady_clock::now();
+  bool unsynced = false;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    //Sleep until there is work or until written data is due to be synced
+    while (pending.empty() and not stopping and not sync_requested) {
+      if (not unsynced) {
+        wake.wait(lock);
+      }
+      else if (std::cv_status::timeout ==
+               wake.wait_until(lock, last_sync + std::chrono::milliseconds(config.sync_ms))) {
+        break;
+      }
+    }
+    //Take the whole group of queued records
+    records.swap(pending);
+    new_names.swap(pending_names);
+    bool stop = stopping;
+    bool force_sync = sync_requested;
+    sync_requested = false;
+    lock.unlock();
+
+    for (auto& name : new_names) {
+      if (names.size() <= name.first) {
+        names.resize(name.first + 1);
+      }
+      names[name.first].swap(name.second);
+    }
+    new_names.clear();
+    bool written = true;
+    for (const Pending& record : records) {
+      if (0 > segment_fd or segment_size + out.size() >= config.segment_bytes) {
+        written = writeAll(out) and written;
+        //Records left unsynced in a closed segment can not be synced later
+        written = rotate() and written;
+        out = magic;
+        putVarint(out, written_sequence);
+      }
+      encode(record, out);
+    }
+    records.clear();
+    written = writeAll(out) and written;
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    bool sync_now = 0 <= segment_fd and (stop or force_sync or 0 == config.sync_ms or
+        now - last_sync >= std::chrono::milliseconds(config.sync_ms));
+    bool synced_now = false;
+    if (sync_now) {
+      if (0 != fdatasync(segment_fd)) {
+        std::cerr<<"Could not sync journal segment: "<<strerror(errno)<<'\n';
+      }
+      else {
+        synced_now = true;
+      }
+      last_sync = now;
+    }
+    //A failed sync is tried again at the next interval
+    unsynced = not synced_now and 0 <= segment_fd and (not sync_now or 0 < config.sync_ms);
+
+    lock.lock();
+    if (not written) {
+      lost = true;
+    }
+    //Only what was written and synced is durable
+    if (synced_now and not lost) {
+      durable_sequence = written_sequence;
+    }
+    synced.notify_all();
+    if (stop and pending.empty()) {
+      break;
+    }
+  }
+}
+
+void TransitionJournal::name(size_t slot, const std::string& uri, const std::string& solution) {
+  if (slot_names.size() <= slot) {
+    slot_names.resize(slot + 1);
+  }
+  slot_names[slot] = next_name++;
+  std::lock_guard<std::mutex> lock(mutex);
+  pending_names.push_back(std::make_pair(slot_names[slot], std::make_pair(uri, solution)));
+}
+
+uint64_t TransitionJournal::record(size_t slot, uint8_t value, int64_t sample_time, int64_t publish_time) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (pending.empty()) {
+    wake.notify_one();
+  }
+  pending.push_back(Pending{slot_names[slot], value, sample_time, publish_time});
+  return next_sequence++;
+}
+
+uint64_t TransitionJournal::durableSequence() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return durable_sequence;
+}
+
+void TransitionJournal::sync() {
+  std::unique_lock<std::mutex> lock(mutex);
+  uint64_t target = next_sequence;
+  if (durable_sequence >= target) {
+    return;
+  }
+  sync_requested = true;
+  wake.notify_one();
+  synced.wait(lock, [&]() { return durable_sequence >= target or stopping or lost; });
+}
+
+void TransitionJournal::scan(const std::string& directory, uint64_t from_sequence,
+                             std::function<void(const Transition&)> f) {
+  std::vector<uint64_t> segments = listSegments(directory);
+  for (size_t i = 0; i < segments.size(); ++i) {
+    //Skip segments that end before the first wanted transition
+    if (i + 1 < segments.size() and segments[i + 1] <= from_sequence) {
+      continue;
+    }
+    SegmentReader reader(segmentPath(directory, segments[i]), segments[i]);
+    Transition t;
+    while (reader.next(t)) {
+      if (t.sequence >= from_sequence) {
+        f(t);
+      }
+    }
+  }
+}
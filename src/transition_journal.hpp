@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file transition_journal.hpp
+ * An append-only, durable journal of every published transition.
+ *
+ * The publishing thread only appends a small fixed size record to an in
+ * memory queue. A background thread encodes the queued records, writes a
+ * whole group of them with one write call and syncs the file with
+ * fdatasync either after every group or at a configured interval (group
+ * commit). The journal is split into segment files that are rotated at a
+ * configured size. Each segment is named after the sequence number of its
+ * first transition and can be decoded on its own.
+ *
+ * Records are compact: object and solution names are written once per
+ * segment and then referred to by number, and times are varints holding
+ * the difference to the previous publish time (publish time) and to the
+ * publish time (sample time).
+ ******************************************************************************/
+
+#ifndef __TRANSITION_JOURNAL_HPP__
+#define __TRANSITION_JOURNAL_HPP__
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class TransitionJournal {
+  public:
+    ///A decoded journal record.
+    struct Transition {
+      uint64_t sequence;
+      std::string uri;
+      std::string solution;
+      uint8_t value;
+      int64_t sample_time;
+      int64_t publish_time;
+    };
+
+    struct Config {
+      ///Directory holding the segment files.
+      std::string directory;
+      ///Longest time between fdatasync calls, 0 to sync every group.
+      int sync_ms;
+      ///Size at which a segment is closed and a new one started.
+      size_t segment_bytes;
+    };
+
+  private:
+    //A queued transition. Names are referred to by number.
+    struct Pending {
+      uint32_t name;
+      uint8_t value;
+      int64_t sample_time;
+      int64_t publish_time;
+    };
+
+    Config config;
+
+    //Owned by the publishing thread: the name number of each sensor slot
+    std::vector<uint32_t> slot_names;
+    uint32_t next_name;
+    uint64_t next_sequence;
+
+    //Shared with the writer thread
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable synced;
+    std::vector<Pending> pending;
+    std::vector<std::pair<uint32_t, std::pair<std::string, std::string>>> pending_names;
+    uint64_t durable_sequence;
+    bool sync_requested;
+    bool stopping;
+    //Set when records could not be written, or were closed in a segment
+    //that could not be synced. The durable position then
+    //stays before them so that they are republished after a restart.
+    bool lost;
+
+    //Owned by the writer thread
+    std::vector<std::pair<std::string, std::string>> names;
+    //Whether each name was written to the current segment yet
+    std::vector<bool> written_names;
+    int segment_fd;
+    size_t segment_size;
+    int64_t last_publish_time;
+    uint64_t written_sequence;
+    std::function<void()> on_start;
+    std::thread writer;
+
+    ///Find the last sequence number in the directory, dropping a torn record at the end.
+    void recover();
+    /**
+     * Sync and close the current segment and start a new one at
+     * written_sequence.
+     * @return false if the closed segment could not be synced or no new
+     *         segment could be created.
+     */
+    bool rotate();
+    ///Wait a second before retrying a failed operation. False if stopping.
+    bool retryLater();
+    void encode(const Pending& record, std::string& out);
+    ///Write all of the buffer, retrying on failure until the journal is stopped.
+    bool writeAll(std::string& out);
+    void run();
+
+    TransitionJournal(const TransitionJournal&) = delete;
+    TransitionJournal& operator=(const TransitionJournal&) = delete;
+
+  public:
+    /**
+     * Open the journal in the configured directory, creating it if needed,
+     * and start the writer thread. Sequence numbers continue from the last
+     * transition already in the directory.
+     * @param on_start Called on the writer thread when it starts, for
+     *                 instance to pin it to its cores.
+     * Throws std::runtime_error if the directory cannot be used.
+     */
+    TransitionJournal(const Config& config, std::function<void()> on_start = std::function<void()>());
+
+    ///Write and sync everything still queued, then stop the writer thread.
+    ~TransitionJournal();
+
+    /**
+     * Set the object and solution that a sensor slot publishes. Call this
+     * whenever a slot is mapped or remapped, before recording its transitions.
+     */
+    void name(size_t slot, const std::string& uri, const std::string& solution);
+
+    /**
+     * Queue a published transition of a named slot.
+     * @return The sequence number of the transition.
+     */
+    uint64_t record(size_t slot, uint8_t value, int64_t sample_time, int64_t publish_time);
+
+    ///Sequence number the next transition will get.
+    uint64_t nextSequence() const { return next_sequence; }
+
+    ///Transitions with lower sequence numbers than this are synced to disk.
+    uint64_t durableSequence();
+
+    ///Wait until every transition recorded so far is synced to disk.
+    void sync();
+
+    /**
+     * Decode every transition in a journal directory, in sequence order,
+     * starting at the given sequence number.
+     * Throws std::runtime_error if a segment cannot be read.
+     */
+    static void scan(const std::string& directory, uint64_t from_sequence,
+                     std::function<void(const Transition&)> f);
+};
+
+#endif //__TRANSITION_JOURNAL_HPP__
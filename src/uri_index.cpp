@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "uri_index.hpp"
+
+#include <algorithm>
+
+const uint32_t UriIndex::no_node;
+const uint32_t UriIndex::root;
+
+UriIndex::UriIndex() : num_slots(0) {
+  nodes.push_back(Node{std::string(), no_node, {}, {}});
+}
+
+uint32_t UriIndex::newNode(const std::string& label, uint32_t parent) {
+  if (free_nodes.empty()) {
+    nodes.push_back(Node{label, parent, {}, {}});
+    return nodes.size() - 1;
+  }
+  uint32_t index = free_nodes.back();
+  free_nodes.pop_back();
+  nodes[index].label = label;
+  nodes[index].parent = parent;
+  return index;
+}
+
+size_t UriIndex::childPosition(uint32_t node, char c) const {
+  const std::vector<uint32_t>& children = nodes[node].children;
+  return std::lower_bound(children.begin(), children.end(), c, [&](uint32_t child, char value) {
+      //Compare as bytes so that children are in URI order
+      return uint8_t(nodes[child].label[0]) < uint8_t(value); }) - children.begin();
+}
+
+void UriIndex::addChild(uint32_t node, uint32_t child) {
+  size_t pos = childPosition(node, nodes[child].label[0]);
+  nodes[node].children.insert(nodes[node].children.begin() + pos, child);
+}
+
+void UriIndex::removeChild(uint32_t node, uint32_t child) {
+  std::vector<uint32_t>& children = nodes[node].children;
+  children.erase(std::find(children.begin(), children.end(), child));
+}
+
+uint32_t UriIndex::findPrefix(const std::string& prefix, bool& exact) const {
+  uint32_t node = root;
+  size_t pos = 0;
+  while (pos < prefix.size()) {
+    const std::vector<uint32_t>& children = nodes[node].children;
+    size_t index = childPosition(node, prefix[pos]);
+    if (index == children.size() or nodes[children[index]].label[0] != prefix[pos]) {
+      return no_node;
+    }
+    uint32_t child = children[index];
+    const std::string& label = nodes[child].label;
+    size_t length = std::min(label.size(), prefix.size() - pos);
+    if (0 != label.compare(0, length, prefix, pos, length)) {
+      return no_node;
+    }
+    pos += length;
+    node = child;
+    if (length < label.size()) {
+      exact = false;
+      return node;
+    }
+  }
+  exact = true;
+  return node;
+}
+
+void UriIndex::add(size_t slot, const std::string& uri) {
+  remove(slot);
+  uint32_t node = root;
+  size_t pos = 0;
+  while (pos < uri.size()) {
+    size_t index = childPosition(node, uri[pos]);
+    if (index == nodes[node].children.size() or nodes[nodes[node].children[index]].label[0] != uri[pos]) {
+      uint32_t leaf = newNode(uri.substr(pos), node);
+      addChild(node, leaf);
+      node = leaf;
+      break;
+    }
+    uint32_t child = nodes[node].children[index];
+    size_t length = std::min(nodes[child].label.size(), uri.size() - pos);
+    size_t common = 0;
+    while (common < length and nodes[child].label[common] == uri[pos + common]) {
+      ++common;
+    }
+    if (common < nodes[child].label.size()) {
+      //Split the child where the URI leaves its label
+      uint32_t middle = newNode(nodes[child].label.substr(0, common), node);
+      nodes[node].children[index] = middle;
+      nodes[child].label.erase(0, common);
+      nodes[child].parent = middle;
+      nodes[middle].children.push_back(child);
+      child = middle;
+    }
+    node = child;
+    pos += common;
+  }
+  nodes[node].slots.push_back(slot);
+  if (slot_nodes.size() <= slot) {
+    slot_nodes.resize(slot + 1, no_node);
+  }
+  slot_nodes[slot] = node;
+  ++num_slots;
+}
+
+void UriIndex::remove(size_t slot) {
+  if (slot >= slot_nodes.size() or no_node == slot_nodes[slot]) {
+    return;
+  }
+  uint32_t node = slot_nodes[slot];
+  std::vector<uint32_t>& slots = nodes[node].slots;
+  slots.erase(std::find(slots.begin(), slots.end(), uint32_t(slot)));
+  slot_nodes[slot] = no_node;
+  --num_slots;
+  prune(node);
+}
+
+void UriIndex::prune(uint32_t node) {
+  Node& n = nodes[node];
+  if (root == node or not n.slots.empty() or 1 < n.children.size()) {
+    return;
+  }
+  uint32_t parent = n.parent;
+  if (n.children.empty()) {
+    removeChild(parent, node);
+  }
+  else {
+    //Merge the only child into this node's place
+    uint32_t child = n.children[0];
+    nodes[child].label.insert(0, n.label);
+    nodes[child].parent = parent;
+    std::vector<uint32_t>& siblings = nodes[parent].children;
+    *std::find(siblings.begin(), siblings.end(), node) = child;
+  }
+  n.label.clear();
+  n.children.clear();
+  n.parent = no_node;
+  free_nodes.push_back(node);
+  //The parent may now end no URI and have a single child
+  prune(parent);
+}
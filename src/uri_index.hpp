@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file uri_index.hpp
+ * A radix trie over the object URIs of the mapped sensors, to find every
+ * sensor under a prefix such as winlab.floor3. without scanning the sensor
+ * table.
+ *
+ * Each URI is stored once, sharing its prefix with its neighbours, and the
+ * node where it ends lists the slots mapped to it. Every node either ends a
+ * URI or has at least two children, so the subtree under a prefix has fewer
+ * nodes than it has URIs and a prefix query costs the length of the prefix
+ * plus the number of results. Mappings are added and removed one at a time
+ * as they change.
+ ******************************************************************************/
+
+#ifndef __URI_INDEX_HPP__
+#define __URI_INDEX_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class UriIndex {
+  private:
+    struct Node {
+      //The characters from the parent to this node
+      std::string label;
+      uint32_t parent;
+      //Children ordered by the first character of their labels
+      std::vector<uint32_t> children;
+      std::vector<uint32_t> slots;
+    };
+
+    static const uint32_t no_node = UINT32_MAX;
+    static const uint32_t root = 0;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> free_nodes;
+    //The node of each slot's URI
+    std::vector<uint32_t> slot_nodes;
+    size_t num_slots;
+
+    uint32_t newNode(const std::string& label, uint32_t parent);
+    ///Index into the children of node of the child whose label starts with c.
+    size_t childPosition(uint32_t node, char c) const;
+    void addChild(uint32_t node, uint32_t child);
+    void removeChild(uint32_t node, uint32_t child);
+    ///Remove a node that ends no URI and merge one with a single child.
+    void prune(uint32_t node);
+    /**
+     * The node whose subtree holds exactly the URIs starting with prefix,
+     * or no_node if there are none.
+     * @param exact Set to true if the prefix ends at the node rather than
+     *              inside its label.
+     */
+    uint32_t findPrefix(const std::string& prefix, bool& exact) const;
+
+  public:
+    UriIndex();
+
+    ///Add a slot mapped to an object URI, moving it if it was mapped before.
+    void add(size_t slot, const std::string& uri);
+
+    ///Remove a slot's mapping.
+    void remove(size_t slot);
+
+    ///Number of slots mapped.
+    size_t size() const { return num_slots; }
+
+    ///Call f(slot) for every slot mapped to exactly this URI.
+    template<typename F>
+    void forExact(const std::string& uri, F f) const {
+      bool exact = false;
+      uint32_t node = findPrefix(uri, exact);
+      if (no_node != node and exact) {
+        for (uint32_t slot : nodes[node].slots) {
+          f(size_t(slot));
+        }
+      }
+    }
+
+    /**
+     * Call f(slot) for every slot whose URI starts with prefix, in URI
+     * order, until f returns false.
+     */
+    template<typename F>
+    void forPrefix(const std::string& prefix, F f) const {
+      bool exact = false;
+      uint32_t start = findPrefix(prefix, exact);
+      if (no_node == start) {
+        return;
+      }
+      std::vector<uint32_t> stack(1, start);
+      while (not stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+        for (uint32_t slot : node.slots) {
+          if (not f(size_t(slot))) {
+            return;
+          }
+        }
+        stack.insert(stack.end(), node.children.rbegin(), node.children.rend());
+      }
+    }
+};
+
+#endif //__URI_INDEX_HPP__
@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "uring_reactor.hpp"
+
+#ifdef BSS_HAVE_IO_URING
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "huge_pages.hpp"
+
+namespace {
+  const unsigned ring_entries = 256;
+  //Receive buffers, together one huge page
+  const unsigned buffer_count = 128;
+  const size_t buffer_size = 16 * 1024;
+  const unsigned short buffer_group = 0;
+
+  bool kernelAtLeast(int major, int minor) {
+    utsname name;
+    int have_major = 0;
+    int have_minor = 0;
+    if (0 != uname(&name) or 2 != sscanf(name.release, "%d.%d", &have_major, &have_minor)) {
+      return false;
+    }
+    return have_major > major or (have_major == major and have_minor >= minor);
+  }
+
+  std::string errorString(const std::string& what) {
+    return what + ": " + strerror(errno);
+  }
+}
+
+UringReactor::UringReactor() : ring_fd(-1), sq_mem(MAP_FAILED), sqes(nullptr), to_submit(0),
+  buf_ring(nullptr), buffers(nullptr), buf_tail(0), next_token(1) {
+  //Multishot receives arrived in 6.0, registered buffer rings in 5.19
+  if (not kernelAtLeast(6, 0)) {
+    throw std::runtime_error("io_uring backend needs Linux 6.0 or newer");
+  }
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+  ring_fd = syscall(__NR_io_uring_setup, ring_entries, &params);
+  if (0 > ring_fd) {
+    throw std::runtime_error(errorString("Could not set up io_uring"));
+  }
+  if (not (params.features & IORING_FEAT_SINGLE_MMAP) or not (params.features & IORING_FEAT_EXT_ARG)) {
+    close(ring_fd);
+    throw std::runtime_error("io_uring is missing required features");
+  }
+
+  //The submission and completion rings share one mapping
+  sq_mem_size = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                         params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+  sq_mem = mmap(nullptr, sq_mem_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+  sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  void* sqe_mem = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+  if (MAP_FAILED == sq_mem or MAP_FAILED == sqe_mem) {
+    std::string err = errorString("Could not map io_uring rings");
+    if (MAP_FAILED != sq_mem) {
+      munmap(sq_mem, sq_mem_size);
+    }
+    close(ring_fd);
+    throw std::runtime_error(err);
+  }
+  sqes = static_cast<io_uring_sqe*>(sqe_mem);
+  char* ring = static_cast<char*>(sq_mem);
+  sq_head = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+  sq_tail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+  sq_mask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+  sq_entries = params.sq_entries;
+  unsigned* sq_array = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+  for (unsigned i = 0; i < sq_entries; ++i) {
+    sq_array[i] = i;
+  }
+  cq_head = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+  cq_tail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+  cq_mask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+  cqes = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+
+  //Register a ring of receive buffers that multishot receives pick from
+  buf_ring_size = buffer_count * sizeof(io_uring_buf);
+  void* buf_ring_mem = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (MAP_FAILED == buf_ring_mem) {
+    std::string err = errorString("Could not map io_uring buffer ring");
+    munmap(sqes, sqes_size);
+    munmap(sq_mem, sq_mem_size);
+    close(ring_fd);
+    throw std::runtime_error(err);
+  }
+  buf_ring = static_cast<io_uring_buf_ring*>(buf_ring_mem);
+  io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+  reg.ring_entries = buffer_count;
+  reg.bgid = buffer_group;
+  if (0 != syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1)) {
+    std::string err = errorString("Could not register io_uring buffer ring");
+    munmap(buf_ring, buf_ring_size);
+    munmap(sqes, sqes_size);
+    munmap(sq_mem, sq_mem_size);
+    close(ring_fd);
+    throw std::runtime_error(err);
+  }
+  buffers = static_cast<char*>(huge_pages::allocate(buffer_count * buffer_size));
+  for (unsigned bid = 0; bid < buffer_count; ++bid) {
+    recycle(bid);
+  }
+}
+
+UringReactor::~UringReactor() {
+  //Closing the ring cancels everything still in flight
+  close(ring_fd);
+  huge_pages::deallocate(buffers, buffer_count * buffer_size);
+  munmap(buf_ring, buf_ring_size);
+  munmap(sqes, sqes_size);
+  munmap(sq_mem, sq_mem_size);
+}
+
+int UringReactor::enter(unsigned submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size) {
+  ++num_syscalls;
+  int ret = syscall(__NR_io_uring_enter, ring_fd, submit, min_complete, flags, arg, arg_size);
+  if (0 <= ret) {
+    to_submit -= std::min<unsigned>(ret, to_submit);
+  }
+  return ret;
+}
+
+io_uring_sqe* UringReactor::nextSqe() {
+  unsigned tail = *sq_tail;
+  if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+    enter(to_submit, 0, 0, nullptr, 0);
+  }
+  io_uring_sqe* sqe = &sqes[tail & sq_mask];
+  memset(sqe, 0, sizeof(*sqe));
+  //The kernel only reads entries inside io_uring_enter, which this thread
+  //makes, so the tail can move before the entry is filled in.
+  __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++to_submit;
+  return sqe;
+}
+
+uint64_t UringReactor::startOp(OpKind kind, int fd) {
+  uint64_t token = next_token++;
+  Op& op = ops[token];
+  op.kind = kind;
+  op.fd = fd;
+  op.cancelled = false;
+  return token;
+}
+
+void UringReactor::armPoll(int fd, Watch& watch) {
+  uint64_t token = startOp(OpKind::poll, fd);
+  io_uring_sqe* sqe = nextSqe();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = POLLIN;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = token;
+  watch.armed = token;
+}
+
+void UringReactor::armReceive(int fd, Watch& watch) {
+  uint64_t token = startOp(OpKind::receive, fd);
+  io_uring_sqe* sqe = nextSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = buffer_group;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->user_data = token;
+  watch.armed = token;
+}
+
+void UringReactor::startSend(int fd, Watch& watch) {
+  if (0 != watch.sending or watch.outgoing.empty()) {
+    return;
+  }
+  uint64_t token = startOp(OpKind::send, fd);
+  Op& op = ops[token];
+  op.data.swap(watch.outgoing);
+  io_uring_sqe* sqe = nextSqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(op.data.data());
+  sqe->len = op.data.size();
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = token;
+  watch.sending = token;
+}
+
+void UringReactor::recycle(unsigned short bid) {
+  //Index the entries directly: the header declares bufs as a flexible array
+  //inside a union, which C++ compilers place after the tail instead of over it.
+  io_uring_buf* buf = reinterpret_cast<io_uring_buf*>(buf_ring) + (buf_tail & (buffer_count - 1));
+  buf->addr = reinterpret_cast<uint64_t>(buffers + bid * buffer_size);
+  buf->len = buffer_size;
+  buf->bid = bid;
+  ++buf_tail;
+  __atomic_store_n(&buf_ring->tail, buf_tail, __ATOMIC_RELEASE);
+}
+
+void UringReactor::add(int fd, std::function<void()> on_readable) {
+  Watch& watch = watches[fd];
+  watch.on_readable = on_readable;
+  armPoll(fd, watch);
+}
+
+void UringReactor::addReceiver(int fd, DataHandler on_data) {
+  setNonBlocking(fd);
+  Watch& watch = watches[fd];
+  watch.on_data = on_data;
+  armReceive(fd, watch);
+}
+
+void UringReactor::remove(int fd) {
+  auto I = watches.find(fd);
+  if (watches.end() == I) {
+    return;
+  }
+  watches.erase(I);
+  for (auto& op : ops) {
+    if (op.second.fd == fd) {
+      op.second.cancelled = true;
+    }
+  }
+  //Cancel now, while the descriptor number still refers to this socket
+  io_uring_sqe* sqe = nextSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = fd;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  sqe->user_data = 0;
+  enter(to_submit, 0, 0, nullptr, 0);
+}
+
+void UringReactor::send(int fd, const char* data, size_t length) {
+  watches[fd].outgoing.append(data, length);
+}
+
+size_t UringReactor::pendingBytes(int fd) const {
+  auto I = watches.find(fd);
+  if (watches.end() == I) {
+    return 0;
+  }
+  size_t pending = I->second.outgoing.size();
+  if (0 != I->second.sending) {
+    pending += ops.at(I->second.sending).data.size();
+  }
+  return pending;
+}
+
+int UringReactor::complete(uint64_t token, int res, unsigned flags) {
+  auto I = ops.find(token);
+  bool has_buffer = flags & IORING_CQE_F_BUFFER;
+  unsigned short bid = flags >> IORING_CQE_BUFFER_SHIFT;
+  //Cancellation results and completions of forgotten operations
+  if (ops.end() == I or I->second.cancelled) {
+    if (has_buffer) {
+      recycle(bid);
+    }
+    if (ops.end() != I and not (flags & IORING_CQE_F_MORE)) {
+      ops.erase(I);
+    }
+    return 0;
+  }
+
+  Op& op = I->second;
+  int fd = op.fd;
+  OpKind kind = op.kind;
+  bool more = flags & IORING_CQE_F_MORE;
+  auto W = watches.find(fd);
+
+  if (OpKind::send == kind) {
+    if (0 < res and size_t(res) < op.data.size()) {
+      //Short send, so send the rest with the same operation
+      op.data.erase(0, res);
+      io_uring_sqe* sqe = nextSqe();
+      sqe->opcode = IORING_OP_SEND;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(op.data.data());
+      sqe->len = op.data.size();
+      sqe->msg_flags = MSG_NOSIGNAL;
+      sqe->user_data = token;
+      return 0;
+    }
+    //Done, or failed in which case a receiver on the socket reports it
+    ops.erase(I);
+    if (watches.end() != W) {
+      W->second.sending = 0;
+      startSend(fd, W->second);
+    }
+    return 0;
+  }
+
+  if (not more) {
+    ops.erase(I);
+  }
+  if (OpKind::poll == kind) {
+    if (-ECANCELED == res) {
+      return 0;
+    }
+    std::function<void()> handler = W->second.on_readable;
+    handler();
+    //Re-arm if the multishot poll ended and the handler did not replace it
+    W = watches.find(fd);
+    if (not more and 0 <= res and watches.end() != W and W->second.armed == token) {
+      armPoll(fd, W->second);
+    }
+    return 1;
+  }
+
+  //A receive
+  if (-ENOBUFS == res) {
+    //Out of buffers, re-arm once some have been returned
+    if (not more and watches.end() != W) {
+      armReceive(fd, W->second);
+    }
+    return 0;
+  }
+  DataHandler handler = W->second.on_data;
+  if (0 < res and has_buffer) {
+    handler(buffers + bid * buffer_size, res);
+    recycle(bid);
+    W = watches.find(fd);
+    if (not more and watches.end() != W and W->second.armed == token) {
+      armReceive(fd, W->second);
+    }
+    return 1;
+  }
+  //Closed or failed
+  if (has_buffer) {
+    recycle(bid);
+  }
+  remove(fd);
+  handler(nullptr, 0);
+  return 1;
+}
+
+int UringReactor::wait(int timeout_ms) {
+  for (auto& watch : watches) {
+    startSend(watch.first, watch.second);
+  }
+
+  //Submit everything and wait in the same system call
+  bool ready = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) != *cq_head;
+  if (ready or 0 == timeout_ms) {
+    if (0 < to_submit) {
+      enter(to_submit, 0, 0, nullptr, 0);
+    }
+  }
+  else if (0 > timeout_ms) {
+    enter(to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+  }
+  else {
+    __kernel_timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+  }
+
+  int called = 0;
+  unsigned head = *cq_head;
+  while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+    io_uring_cqe cqe = cqes[head & cq_mask];
+    ++head;
+    //Free the entry before calling handlers, which may submit more work
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    if (0 != cqe.user_data) {
+      called += complete(cqe.user_data, cqe.res, cqe.flags);
+    }
+  }
+  return called;
+}
+
+#endif //BSS_HAVE_IO_URING
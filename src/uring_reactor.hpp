@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file uring_reactor.hpp
+ * Completion based reactor backend built directly on the io_uring system
+ * calls. Readable notifications use multishot polls, receivers use
+ * multishot receives that pick buffers from a registered buffer ring, and
+ * every queued send is submitted together with the wait in one
+ * io_uring_enter call.
+ ******************************************************************************/
+
+#ifndef __URING_REACTOR_HPP__
+#define __URING_REACTOR_HPP__
+
+#include <map>
+#include <string>
+
+#include "reactor.hpp"
+
+//The backend needs kernel headers with multishot receives (Linux 6.0)
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#ifdef IORING_RECV_MULTISHOT
+#define BSS_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+#ifdef BSS_HAVE_IO_URING
+
+class UringReactor : public Reactor {
+  private:
+    enum class OpKind {poll, receive, send};
+
+    //An operation submitted to the kernel, identified by its user data
+    struct Op {
+      OpKind kind;
+      int fd;
+      //Set when the descriptor was removed; completions are then dropped
+      bool cancelled;
+      //Data of a send that is in flight
+      std::string data;
+    };
+
+    struct Watch {
+      std::function<void()> on_readable;
+      DataHandler on_data;
+      //Token of the armed multishot operation
+      uint64_t armed;
+      //Data waiting for the in flight send to finish
+      std::string outgoing;
+      //Token of the in flight send, or zero
+      uint64_t sending;
+    };
+
+    int ring_fd;
+    //Submission queue
+    void* sq_mem;
+    size_t sq_mem_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+    unsigned to_submit;
+    //Completion queue, in the same mapping as the submission queue
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe* cqes;
+    //Registered receive buffers
+    struct io_uring_buf_ring* buf_ring;
+    size_t buf_ring_size;
+    char* buffers;
+    unsigned short buf_tail;
+
+    uint64_t next_token;
+    std::map<uint64_t, Op> ops;
+    std::map<int, Watch> watches;
+
+    ///Get a free submission entry, submitting pending ones if the queue is full.
+    struct io_uring_sqe* nextSqe();
+    ///Call io_uring_enter, returning its result and counting the system call.
+    int enter(unsigned submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size);
+    ///Start a new operation and return its token.
+    uint64_t startOp(OpKind kind, int fd);
+    void armPoll(int fd, Watch& watch);
+    void armReceive(int fd, Watch& watch);
+    void startSend(int fd, Watch& watch);
+    ///Give a receive buffer back to the kernel.
+    void recycle(unsigned short bid);
+    ///Handle one completion, returning the number of handlers called.
+    int complete(uint64_t token, int res, unsigned flags);
+
+    UringReactor(const UringReactor&) = delete;
+    UringReactor& operator=(const UringReactor&) = delete;
+
+  public:
+    /**
+     * Set up the rings and register the receive buffers.
+     * Throws std::runtime_error if the kernel does not support io_uring
+     * with multishot receives and registered buffer rings.
+     */
+    UringReactor();
+    ~UringReactor();
+
+    void add(int fd, std::function<void()> on_readable);
+    void addReceiver(int fd, DataHandler on_data);
+    void remove(int fd);
+    void send(int fd, const char* data, size_t length);
+    size_t pendingBytes(int fd) const;
+    int wait(int timeout_ms);
+    const char* name() const { return "io_uring"; }
+};
+
+#endif //BSS_HAVE_IO_URING
+
+#endif //__URING_REACTOR_HPP__
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+#include "utf8.hpp"
+
+#include <cstdint>
+
+namespace {
+  const char32_t replacement = 0xFFFD;
+
+  void putCodePoint(std::string& out, char32_t cp) {
+    if (cp < 0x80) {
+      out.push_back(char(cp));
+    }
+    else if (cp < 0x800) {
+      out.push_back(char(0xC0 | (cp >> 6)));
+      out.push_back(char(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000) {
+      out.push_back(char(0xE0 | (cp >> 12)));
+      out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(char(0x80 | (cp & 0x3F)));
+    }
+    else {
+      out.push_back(char(0xF0 | (cp >> 18)));
+      out.push_back(char(0x80 | ((cp >> 12) & 0x3F)));
+      out.push_back(char(0x80 | ((cp >> 6) & 0x3F)));
+      out.push_back(char(0x80 | (cp & 0x3F)));
+    }
+  }
+
+  void putUnits(std::u16string& out, char32_t cp) {
+    if (cp < 0x10000) {
+      out.push_back(char16_t(cp));
+    }
+    else {
+      cp -= 0x10000;
+      out.push_back(char16_t(0xD800 | (cp >> 10)));
+      out.push_back(char16_t(0xDC00 | (cp & 0x3FF)));
+    }
+  }
+}
+
+void utf8::append(std::string& out, const std::u16string& str) {
+  //Copy the ASCII start of the string, usually all of it, without checks
+  size_t i = 0;
+  size_t start = out.size();
+  out.resize(start + str.size());
+  while (i < str.size() and str[i] < 0x80) {
+    out[start + i] = char(str[i]);
+    ++i;
+  }
+  out.resize(start + i);
+  for (; i < str.size(); ++i) {
+    char32_t unit = str[i];
+    if (unit < 0x80) {
+      out.push_back(char(unit));
+    }
+    else if (unit < 0xD800 or 0xDFFF < unit) {
+      putCodePoint(out, unit);
+    }
+    //A high surrogate must be followed by a low one
+    else if (unit < 0xDC00 and i + 1 < str.size() and 0xDC00 <= str[i+1] and str[i+1] <= 0xDFFF) {
+      putCodePoint(out, 0x10000 + ((unit - 0xD800) << 10) + (str[i+1] - 0xDC00));
+      ++i;
+    }
+    else {
+      putCodePoint(out, replacement);
+    }
+  }
+}
+
+std::string utf8::encode(const std::u16string& str) {
+  std::string out;
+  append(out, str);
+  return out;
+}
+
+std::u16string utf8::decode(const char* data, size_t size) {
+  const uint8_t* in = reinterpret_cast<const uint8_t*>(data);
+  std::u16string out;
+  out.reserve(size);
+  size_t i = 0;
+  while (i < size) {
+    uint8_t lead = in[i];
+    if (lead < 0x80) {
+      out.push_back(lead);
+      ++i;
+      continue;
+    }
+    size_t length;
+    char32_t cp;
+    char32_t minimum;
+    if (0xC0 == (lead & 0xE0)) {
+      length = 2;
+      cp = lead & 0x1F;
+      minimum = 0x80;
+    }
+    else if (0xE0 == (lead & 0xF0)) {
+      length = 3;
+      cp = lead & 0x0F;
+      minimum = 0x800;
+    }
+    else if (0xF0 == (lead & 0xF8)) {
+      length = 4;
+      cp = lead & 0x07;
+      minimum = 0x10000;
+    }
+    else {
+      //A continuation byte without a lead byte, or an invalid lead byte
+      out.push_back(char16_t(replacement));
+      ++i;
+      continue;
+    }
+    size_t used = 1;
+    while (used < length and i + used < size and 0x80 == (in[i + used] & 0xC0)) {
+      cp = (cp << 6) | (in[i + used] & 0x3F);
+      ++used;
+    }
+    //Truncated sequences, overlong forms, surrogates and values past
+    //U+10FFFF are all replaced
+    if (used < length or cp < minimum or 0x10FFFF < cp or (0xD800 <= cp and cp <= 0xDFFF)) {
+      cp = replacement;
+    }
+    putUnits(out, cp);
+    i += used;
+  }
+  return out;
+}
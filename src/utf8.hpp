@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2012 Bernhard Firner and Rutgers University
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA
+ * or visit http://www.gnu.org/licenses/gpl-2.0.html
+ */
+
+/*******************************************************************************
+ * @file utf8.hpp
+ * Conversions between the UTF-16 strings of the world model protocol and
+ * the UTF-8 strings that the solver keeps internally. Names are nearly
+ * always ASCII, which UTF-8 stores in half the space of UTF-16.
+ *
+ * Both directions handle every code point, including those outside the
+ * basic multilingual plane. Malformed input (a lone surrogate, or an
+ * invalid or truncated UTF-8 sequence) becomes U+FFFD instead of being
+ * silently truncated to a byte.
+ ******************************************************************************/
+
+#ifndef __UTF8_HPP__
+#define __UTF8_HPP__
+
+#include <cstddef>
+#include <string>
+
+namespace utf8 {
+  ///Encode a UTF-16 string as UTF-8.
+  std::string encode(const std::u16string& str);
+
+  ///Append the UTF-8 encoding of a UTF-16 string to out.
+  void append(std::string& out, const std::u16string& str);
+
+  ///Decode UTF-8 bytes into a UTF-16 string.
+  std::u16string decode(const char* data, size_t size);
+
+  inline std::u16string decode(const std::string& str) {
+    return decode(str.data(), str.size());
+  }
+}
+
+#endif //__UTF8_HPP__